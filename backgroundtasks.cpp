@@ -0,0 +1,562 @@
+// backgroundtasks.cpp
+//
+// implements everything described in backgroundtasks.hpp
+
+// includes
+#include <cstring>
+#include <QBuffer>
+#include <QHash>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QMarginsF>
+#include <QPageSize>
+#include <QPainter>
+#include <QPdfWriter>
+#include <QSvgGenerator>
+#include "backgroundtasks.hpp"
+#include "boardrenderer.hpp"
+#include "constants.hpp"
+#include "pngstream.hpp"
+
+// function that will draw the given board and scale it down to the given size for a preview. the board is drawn at
+// full size first so that the lines and text come out the same as they do on screen
+static QImage drawPreview(BoardRenderer &renderer, DrawOperations *board, int width, int height) {
+    QImage image(1920, 1080, QImage::Format_RGB32);
+    renderer.render(board, &image, QTransform());
+    return image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+// constructor for the class
+SaveThread::SaveThread(const QString &filename, DrawOperations **snapshot, unsigned int total_images, const QVector<JournalEvent> &events,
+    unsigned int journal_index, const JournalState &journal, int compression_level, bool embed_assets, bool previews, bool append, QObject *parent)
+: QThread(parent), save_filename(filename), snapshot(snapshot), total_images(total_images), events(events), journal_index(journal_index), journal(journal), compression_level(compression_level), embed_assets(embed_assets), previews(previews), append(append), success(false)
+{
+    save_progress.done.storeRelease(0);
+    save_progress.cancelled.storeRelease(0);
+    save_progress.failed.storeRelease(0);
+}
+
+// destructor for the class. the snapshot is deleted here so that it goes on the gui thread
+SaveThread::~SaveThread() {
+    freeWhiteboard(snapshot, total_images);
+}
+
+// function that will return the name of the file being saved
+const QString &SaveThread::filename() {
+    return save_filename;
+}
+
+// function that will return the journal of the file once the save has finished
+const JournalState &SaveThread::journalState() {
+    return journal;
+}
+
+// function that will return the progress of the save
+TaskProgress *SaveThread::progress() {
+    return &save_progress;
+}
+
+// function that will return the snapshot being saved
+DrawOperations **SaveThread::snapshotImages() {
+    return snapshot;
+}
+
+// function that will tell us if the save finished successfully
+const bool SaveThread::succeeded() {
+    return success;
+}
+
+// function that will return how many images are being saved
+const unsigned int SaveThread::totalImages() {
+    return total_images;
+}
+
+// overridden run method that either appends to the journal or writes the whole whiteboard. a whole file starts with
+// its previews, so if asked to the thumbnails of any images that changed since theirs were made are brought up to
+// date in the snapshot and the cover is drawn from the first image. the snapshot is drawn without touching the
+// keyframes of the images so the whiteboard can carry on drawing them
+void SaveThread::run() {
+    if(append) {
+        success = appendJournal(snapshot, total_images, events, journal_index, &journal, &save_progress);
+        return;
+    }
+    QByteArray cover;
+    if(previews) {
+        BoardRenderer renderer(EXPORT_RENDER_OPTIONS);
+        for(unsigned int i = 0; i < total_images && !save_progress.cancelled.loadAcquire(); i++) {
+            if(snapshot[i]->thumbnailCurrent())
+                continue;
+            snapshot[i]->thumbnail = encodePreview(drawPreview(renderer, snapshot[i], THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+            snapshot[i]->thumbnail_ops = snapshot[i]->total_ops;
+            snapshot[i]->thumbnail_valid = true;
+        }
+        if(total_images > 0)
+            cover = encodePreview(drawPreview(renderer, snapshot[0], COVER_WIDTH, COVER_HEIGHT));
+    }
+    success = saveWhiteboard(save_filename, snapshot, total_images, compression_level, embed_assets, cover, &journal, &save_progress);
+}
+
+// constructor for the class
+BoardLoadTask::BoardLoadTask(WhiteboardReader *reader, const BoardEntry &entry, const QString &filename, QVector<ImageAsset *> &assets, DrawOperations **result)
+: reader(reader), entry(entry), filename(filename), assets(&assets), result(result)
+{
+}
+
+// overridden run method that loads the board straight from its place in the data
+void BoardLoadTask::run() {
+    *result = loadBoard(reader, entry, filename, *assets);
+}
+
+// constructor for the class
+BoardLoader::BoardLoader(const QString &filename, bool viewer, QObject *parent)
+: QObject(parent), filename(filename), viewer(viewer), file(filename)
+{
+    reader.data = NULL;
+    reader.size = 0;
+    reader.position = 0;
+    reader.failed = false;
+    whiteboard = NULL;
+    whiteboard_total = 0;
+    whiteboard_max = 0;
+    whiteboard_damaged = false;
+}
+
+// destructor for the class. the boards still waiting are taken off the queue so the tasks stop after the board
+// they are on, then anything left over is thrown away along with our references to the images
+BoardLoader::~BoardLoader() {
+    mutex.lock();
+    queue.clear();
+    mutex.unlock();
+    pool.waitForDone();
+    for(int i = 0; i < boards.size(); i++)
+        delete boards[i];
+    for(int i = 0; i < assets.size(); i++)
+        releaseImageAsset(assets[i]);
+    if(whiteboard != NULL)
+        freeWhiteboard(whiteboard, whiteboard_max);
+}
+
+// function that will open the file and load the first board, or the whole whiteboard if the file can't be opened
+// progressively
+bool BoardLoader::open(JournalState *journal) {
+    if(openProgressive(journal))
+        return true;
+
+    // let go of anything that was read in and load the whole whiteboard instead
+    for(int i = 0; i < boards.size(); i++)
+        delete boards[i];
+    for(int i = 0; i < assets.size(); i++)
+        releaseImageAsset(assets[i]);
+    boards.clear();
+    assets.clear();
+    directory.clear();
+    file.close();
+    contents.clear();
+    whiteboard = loadWhiteboard(filename, &whiteboard_total, &whiteboard_max, journal, &whiteboard_damaged);
+    return whiteboard != NULL;
+}
+
+// function that will open the file progressively, loading just the first board. the file stays mapped in until
+// the loader is deleted so the rest of the boards can be loaded straight out of it
+bool BoardLoader::openProgressive(JournalState *journal) {
+    // map the file in and read where each of the boards are
+    if(!mapWhiteboardFile(file, &reader, contents))
+        return false;
+    unsigned int magic = 0;
+    if(reader.size >= (qint64) sizeof(unsigned int))
+        memcpy(&magic, reader.data, sizeof(unsigned int));
+    unsigned int flags = 0;
+    if(magic != WBD_MAGIC || !loadBoardDirectory(&reader, &flags, directory))
+        return false;
+
+    // load in the embedded images. the ops of the boards only hold the ids of these. the viewer leaves them where
+    // they are in the file so nothing is read in until they are drawn
+    bool embedded = (flags & WBD_EMBEDDED_ASSETS) != 0;
+    if(embedded && !loadAssetTable(&reader, filename, assets, viewer))
+        return false;
+
+    // a journal can insert and delete boards so the boards can only be shown as they arrive if there isn't one
+    quint64 boards_end = reader.position;
+    for(int i = 0; i < directory.size(); i++)
+        boards_end = qMax(boards_end, directory[i].offset + directory[i].size);
+    if(boards_end != (quint64) reader.size)
+        return false;
+
+    // load the first board now so it can be shown straight away
+    boards.fill(NULL, directory.size());
+    boards[0] = loadBoard(&reader, directory[0], filename, assets);
+    if(boards[0] == NULL)
+        return false;
+
+    // the journal starts at the end of the file and saves look up the embedded images by their ids
+    QHash<QByteArray, unsigned int> asset_ids;
+    for(int i = 0; i < assets.size(); i++) {
+        if(!asset_ids.contains(assets[i]->hash))
+            asset_ids.insert(assets[i]->hash, i);
+    }
+    journal->filename = filename;
+    journal->start = boards_end;
+    journal->end = boards_end;
+    journal->embedded = embedded;
+    journal->assets = asset_ids;
+    return true;
+}
+
+// function that will tell us if any boards of the whole whiteboard were damaged and left empty
+const bool BoardLoader::damaged() {
+    return whiteboard_damaged;
+}
+
+// function that will move the given board to the front of the queue if it hasn't been loaded yet
+void BoardLoader::prioritise(unsigned int index) {
+    QMutexLocker locker(&mutex);
+    if(queue.removeOne(index))
+        queue.prepend(index);
+}
+
+// function that will tell us if the boards after the first are being loaded in the background
+const bool BoardLoader::progressive() {
+    return !directory.isEmpty();
+}
+
+// function that will return the images of the whiteboard and start loading the rest of the boards
+DrawOperations **BoardLoader::start(unsigned int *image_total, unsigned int *image_max) {
+    // a whiteboard that was loaded in full is just handed over
+    if(whiteboard != NULL) {
+        DrawOperations **ops = whiteboard;
+        whiteboard = NULL;
+        *image_total = whiteboard_total;
+        *image_max = whiteboard_max;
+        return ops;
+    }
+
+    // put the first board in place and an empty image holding the title and thumbnail for every other board, so the
+    // thumbnail can be shown until the board itself is in
+    unsigned int total_images = directory.size();
+    unsigned int max_images = 0;
+    DrawOperations **ops = allocateWhiteboard(total_images, &max_images);
+    ops[0] = boards[0];
+    boards[0] = NULL;
+    for(unsigned int i = 1; i < total_images; i++) {
+        ops[i] = (DrawOperations *) new DrawOperations();
+        ops[i]->title = directory[i].title;
+        ops[i]->thumbnail = directory[i].thumbnail;
+    }
+    for(unsigned int i = total_images; i < max_images; i++)
+        ops[i] = (DrawOperations *) new DrawOperations();
+    for(unsigned int journal = 0; journal < TOTAL_JOURNALS; journal++)
+        ops[0]->markJournalled(journal);
+    *image_max = max_images;
+    *image_total = total_images;
+
+    // the viewer loads each board when it is viewed and decodes its images when they are drawn
+    if(viewer)
+        return ops;
+    queueAssetDecodes(ops, 1);
+    for(unsigned int i = 1; i < total_images; i++)
+        queue.append(i);
+
+    // start a task for each thread of the pool, each one takes boards off the queue until it is empty
+    int total_tasks = qMin(pool.maxThreadCount(), queue.size());
+    for(int i = 0; i < total_tasks; i++)
+        pool.start(new BoardStreamTask(this));
+    return ops;
+}
+
+// function that will load boards off the queue until it is empty. the boards only read from the data and the
+// images so the tasks don't get in each others way
+void BoardLoader::streamBoards() {
+    QMutexLocker locker(&mutex);
+    while(!queue.isEmpty()) {
+        // load the board at the front of the queue without holding on to the mutex
+        unsigned int index = queue.takeFirst();
+        locker.unlock();
+        DrawOperations *board = loadBoard(&reader, directory[index], filename, assets);
+        locker.relock();
+
+        // keep the board until it is taken and let the gui thread know it is there
+        boards[index] = board;
+        QMetaObject::invokeMethod(this, "boardReady", Qt::QueuedConnection, Q_ARG(int, (int) index));
+    }
+}
+
+// function that will hand over a board once boardLoaded has been emitted for it
+DrawOperations *BoardLoader::takeBoard(unsigned int index, bool *damaged) {
+    // take the board out of the loader so it isn't deleted along with it
+    mutex.lock();
+    DrawOperations *board = boards[index];
+    boards[index] = NULL;
+    mutex.unlock();
+
+    // a damaged board is replaced with an empty one that keeps its title
+    *damaged = board == NULL;
+    if(board == NULL) {
+        board = (DrawOperations *) new DrawOperations();
+        board->title = directory[index].title;
+    }
+    for(unsigned int journal = 0; journal < TOTAL_JOURNALS; journal++)
+        board->markJournalled(journal);
+
+    // get the images of the board decoding in the background
+    queueAssetDecodes(&board, 1);
+    return board;
+}
+
+// function that will throw away the decoded embedded images that none of the boards are using anymore, so the
+// viewer only keeps the images of the boards it still holds
+void BoardLoader::trimAssets() {
+    for(int i = 0; i < assets.size(); i++)
+        trimImageAsset(assets[i]);
+}
+
+// function that will load a board for the viewer straight away
+DrawOperations *BoardLoader::viewBoard(unsigned int index, bool *damaged) {
+    DrawOperations *board = loadBoard(&reader, directory[index], filename, assets);
+    *damaged = board == NULL;
+    if(board == NULL) {
+        board = (DrawOperations *) new DrawOperations();
+        board->title = directory[index].title;
+    }
+    return board;
+}
+
+// slot that passes on a board that a task has loaded
+void BoardLoader::boardReady(int index) {
+    emit boardLoaded(index);
+}
+
+// constructor for the class
+BoardStreamTask::BoardStreamTask(BoardLoader *loader)
+: loader(loader)
+{
+}
+
+// overridden run method that loads boards for the loader until there are none left
+void BoardStreamTask::run() {
+    loader->streamBoards();
+}
+
+// constructor for the class
+WhiteboardOpenTask::WhiteboardOpenTask(BoardLoader *loader, JournalState *journal, bool *result)
+: loader(loader), journal(journal), result(result)
+{
+}
+
+// overridden run method that opens the file
+void WhiteboardOpenTask::run() {
+    *result = loader->open(journal);
+}
+
+// constructor for the class
+AssetDecodeTask::AssetDecodeTask(ImageAsset *asset)
+: asset(asset)
+{
+    retainImageAsset(asset);
+}
+
+// destructor for the class
+AssetDecodeTask::~AssetDecodeTask() {
+    releaseImageAsset(asset);
+}
+
+// overridden run method that decodes the image. the renderer of an svg image is handed over to the gui thread once
+// it is made, so those can be decoded here as well
+void AssetDecodeTask::run() {
+    if(asset->vector)
+        assetSVG(asset);
+    else
+        assetRaster(asset);
+}
+
+// overridden run method that loads the plugins by writing a tiny image in each of the formats the whiteboard
+// imports and reading it back. svg images are drawn by the svg module directly so they don't need a plugin
+void PluginWarmTask::run() {
+    QImage pixel(1, 1, QImage::Format_RGB32);
+    pixel.fill(Qt::white);
+    const char *formats[] = {"PNG", "JPG"};
+    for(unsigned int i = 0; i < 2; i++) {
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        pixel.save(&buffer, formats[i]);
+        QImage::fromData(data, formats[i]);
+    }
+}
+
+// constructor for the class
+BoardExportTask::BoardExportTask(DrawOperations *board, unsigned int index, unsigned int total_images, qreal scale, const QString &filename, TaskProgress *progress)
+: board(board), index(index), total_images(total_images), scale(scale), filename(filename), progress(progress)
+{
+}
+
+// overridden run method that draws and writes the board unless the export has been cancelled. the ops are replayed
+// through the scale rather than the image being scaled up afterwards so the board stays sharp at any size
+void BoardExportTask::run() {
+    if(!progress->cancelled.loadAcquire()) {
+        // images up to 4K are drawn whole and written straight out from this thread, anything bigger is drawn and
+        // written a strip at a time so it never has to be held in memory all at once
+        int width = qRound(1920 * scale);
+        int height = qRound(1080 * scale);
+        bool written;
+        if((qint64) width * height * 4 <= EXPORT_TILE_THRESHOLD) {
+            QImage image(width, height, QImage::Format_RGB32);
+            image.setDotsPerMeterX(qRound(EXPORT_BASE_DPI * scale / 0.0254));
+            image.setDotsPerMeterY(qRound(EXPORT_BASE_DPI * scale / 0.0254));
+            drawStrip(image, 0);
+            written = image.save(filename, "PNG");
+        } else {
+            written = writeStrips(width, height);
+        }
+
+        // a file that was given up on part way through is taken away again
+        if(!written) {
+            QFile::remove(filename);
+            if(!progress->cancelled.loadAcquire())
+                progress->failed.ref();
+        }
+    }
+    progress->done.ref();
+}
+
+// private function that will draw the part of the board that starts the given number of rows down the image
+void BoardExportTask::drawStrip(QImage &strip, int top) {
+    // draw the whole board with its number and title along the bottom. the painter is clipped to the part of the
+    // board the strip covers so the renderer can skip everything that falls outside of it
+    BoardRenderer renderer(EXPORT_RENDER_OPTIONS);
+    QPainter painter;
+    painter.begin(&strip);
+    painter.translate(0, -top);
+    painter.scale(scale, scale);
+    painter.setClipRect(QRectF(0, top / scale, 1920, strip.height() / scale));
+    renderer.render(board, painter, board->total_ops);
+    renderer.drawFooter(painter, index, total_images, board->title);
+    painter.end();
+}
+
+// private function that will draw and write the board a strip at a time. this stops early if the export is
+// cancelled and returns true if the whole file was written
+bool BoardExportTask::writeStrips(int width, int height) {
+    PNGStreamWriter writer(filename, width, height, EXPORT_BASE_DPI * scale);
+    if(!writer.open())
+        return false;
+    int strip_height = exportStripHeight(scale);
+    QImage strip(width, strip_height, QImage::Format_RGB32);
+    for(int top = 0; top < height; top += strip_height) {
+        if(progress->cancelled.loadAcquire())
+            return false;
+        drawStrip(strip, top);
+        if(!writer.writeRows(strip, qMin(strip_height, height - top)))
+            return false;
+    }
+    return writer.finish();
+}
+
+// constructor for the class
+PDFExportTask::PDFExportTask(DrawOperations **boards, unsigned int total_images, const QString &filename, TaskProgress *progress)
+: boards(boards), total_images(total_images), filename(filename), progress(progress)
+{
+}
+
+// overridden run method that draws each board onto its own page unless the export has been cancelled. the ops are
+// drawn as shapes and text so they stay sharp, and an image used on several boards is only put in the file once as
+// every op using it draws the same decoded image
+void PDFExportTask::run() {
+    unsigned int drawn = 0;
+    bool written = false;
+    {
+        // each page is the size of a board at the base dpi so the boards are drawn onto them as they are
+        QPdfWriter writer(filename);
+        writer.setCreator(QString("qt_whiteboard"));
+        writer.setPageSize(QPageSize(QSizeF(1920 / EXPORT_BASE_DPI, 1080 / EXPORT_BASE_DPI), QPageSize::Inch));
+        writer.setPageMargins(QMarginsF(0, 0, 0, 0));
+        writer.setResolution(EXPORT_BASE_DPI);
+
+        // draw the boards with their numbers and titles along the bottom, one to a page. the last board is only
+        // counted once the file is finished, as the boards are freed once every one of them has been counted
+        QPainter painter;
+        if(painter.begin(&writer)) {
+            BoardRenderer renderer(VECTOR_RENDER_OPTIONS);
+            while(drawn < total_images && !progress->cancelled.loadAcquire()) {
+                if(drawn > 0)
+                    writer.newPage();
+                renderer.render(boards[drawn], painter, boards[drawn]->total_ops);
+                renderer.drawFooter(painter, drawn, total_images, boards[drawn]->title);
+                drawn++;
+                if(drawn < total_images)
+                    progress->done.ref();
+            }
+            written = painter.end() && drawn == total_images;
+        }
+    }
+
+    // a file that wasn't finished is taken away again. every board that wasn't counted yet is counted now
+    if(!written) {
+        QFile::remove(filename);
+        if(!progress->cancelled.loadAcquire())
+            progress->failed.ref();
+    }
+    progress->done.fetchAndAddOrdered(total_images - qMin(drawn, total_images - 1));
+}
+
+// constructor for the class
+SVGExportTask::SVGExportTask(DrawOperations *board, unsigned int index, unsigned int total_images, const QString &filename, TaskProgress *progress)
+: board(board), index(index), total_images(total_images), filename(filename), progress(progress)
+{
+}
+
+// overridden run method that draws the board into an SVG document unless the export has been cancelled. each
+// freehand line becomes a single path and runs of points and lines that look the same are merged together, so the
+// document stays small. svg images are drawn into the document as shapes rather than being linked to
+void SVGExportTask::run() {
+    if(!progress->cancelled.loadAcquire()) {
+        bool written = false;
+        {
+            // the document is the size of a board so the board is drawn into it as it is
+            QSvgGenerator generator;
+            generator.setFileName(filename);
+            generator.setSize(QSize(1920, 1080));
+            generator.setViewBox(QRect(0, 0, 1920, 1080));
+            generator.setResolution(EXPORT_BASE_DPI);
+            generator.setTitle(board->title);
+
+            // draw the whole board with its number and title along the bottom, the document is written out when
+            // the painter is ended
+            QPainter painter;
+            if(painter.begin(&generator)) {
+                BoardRenderer renderer(VECTOR_RENDER_OPTIONS);
+                renderer.render(board, painter, board->total_ops);
+                renderer.drawFooter(painter, index, total_images, board->title);
+                written = painter.end();
+            }
+        }
+
+        // a document that couldn't be written is taken away again once the generator has let go of it
+        if(!written) {
+            QFile::remove(filename);
+            if(!progress->cancelled.loadAcquire())
+                progress->failed.ref();
+        }
+    }
+    progress->done.ref();
+}
+
+// functions
+
+// function that will return how many rows of an image exported at the given scale are drawn at once when it is too
+// big to be drawn whole. the strips are as tall as they can be while one for each core fits into the memory budget,
+// so every strip doesn't have to go through the whole board again for only a few rows
+int exportStripHeight(qreal scale) {
+    qint64 row_size = (qint64) qRound(1920 * scale) * 4;
+    qint64 rows = EXPORT_MEMORY_BUDGET / (row_size * qMax(1, QThread::idealThreadCount()));
+    return (int) qBound((qint64) EXPORT_TILE_HEIGHT, rows, (qint64) qRound(1080 * scale));
+}
+
+// function that will return how many threads boards should be exported on at the given scale
+int exportThreadCount(qreal scale) {
+    // images above the tile threshold only ever have a strip of themselves in memory
+    qint64 image_size = (qint64) qRound(1920 * scale) * qRound(1080 * scale) * 4;
+    if(image_size > EXPORT_TILE_THRESHOLD)
+        image_size = (qint64) qRound(1920 * scale) * exportStripHeight(scale) * 4;
+    int threads = (int) qMax((qint64) 1, EXPORT_MEMORY_BUDGET / image_size);
+    return qMax(1, qMin(QThread::idealThreadCount(), threads));
+}
@@ -0,0 +1,314 @@
+#ifndef _BACKGROUNDTASKS_HPP
+#define _BACKGROUNDTASKS_HPP
+
+// backgroundtasks.hpp
+//
+// defines the tasks that load, save and export a whiteboard away from the gui thread so that drawing can carry on
+// while they run. each task works on its own copy of what it needs and reports back through a task progress or
+// the result it was given
+
+// includes
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QRunnable>
+#include <QString>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include "drawoperations.hpp"
+#include "fileops.hpp"
+#include "imageasset.hpp"
+
+// class definition for the thread that saves a snapshot of a whiteboard
+class SaveThread : public QThread {
+    // needed to get access to the signals and slots mechanism
+    Q_OBJECT
+// public section of the class
+public:
+    // constructor for the class. the thread takes over the snapshot and deletes it when it is deleted, so it must
+    // be deleted on the gui thread. if append is true the changes since the marks of the given journal index are
+    // appended to the journal, otherwise the whole whiteboard is written with its images embedded if asked to. if
+    // previews is true the thumbnails of any changed images and the cover are drawn before the whole file is written
+    SaveThread(const QString &filename, DrawOperations **snapshot, unsigned int total_images, const QVector<JournalEvent> &events,
+        unsigned int journal_index, const JournalState &journal, int compression_level, bool embed_assets, bool previews, bool append, QObject *parent = 0);
+    // destructor for the class
+    ~SaveThread();
+    // function that will return the name of the file being saved
+    const QString &filename();
+    // function that will return the journal of the file once the save has finished
+    const JournalState &journalState();
+    // function that will return the progress of the save
+    TaskProgress *progress();
+    // function that will return the snapshot being saved, which holds the thumbnails drawn for it once the save has
+    // finished
+    DrawOperations **snapshotImages();
+    // function that will tell us if the save finished successfully
+    const bool succeeded();
+    // function that will return how many images are being saved
+    const unsigned int totalImages();
+// protected section of the class
+protected:
+    // overridden run method that does the saving
+    void run();
+// private section of the class
+private:
+    // the file being saved, the snapshot of the whiteboard being saved and how many images it has
+    QString save_filename;
+    DrawOperations **snapshot;
+    unsigned int total_images;
+    // the images that were inserted and deleted since the last save
+    QVector<JournalEvent> events;
+    // which set of marks the changes are measured against and the journal of the file being saved
+    unsigned int journal_index;
+    JournalState journal;
+    // how much to compress the images, whether to embed the images, whether to draw the previews and whether we
+    // are appending to the journal
+    int compression_level;
+    bool embed_assets;
+    bool previews;
+    bool append;
+    // the progress of the save and whether it finished successfully
+    TaskProgress save_progress;
+    bool success;
+};
+
+// class definition for the task that loads a single board of a whiteboard file. this is run on a thread pool so
+// that all of the boards of a file are loaded at once
+class BoardLoadTask : public QRunnable {
+// public section of the class
+public:
+    // constructor for the class. the loaded board is written to result, which is left null if it is damaged. the
+    // data and images must stay around until the task has finished
+    BoardLoadTask(WhiteboardReader *reader, const BoardEntry &entry, const QString &filename, QVector<ImageAsset *> &assets, DrawOperations **result);
+    // overridden run method that loads the board
+    void run();
+// private section of the class
+private:
+    // the data of the file, where the board is in it and the name of the file
+    WhiteboardReader *reader;
+    BoardEntry entry;
+    QString filename;
+    // the images embedded in the file and where the board goes once it is loaded
+    QVector<ImageAsset *> *assets;
+    DrawOperations **result;
+};
+
+// class definition for the loader that opens a whiteboard file progressively. the first board is loaded straight
+// away so it can be shown while the rest are loaded on a thread pool in the background, with any board that is
+// asked for moved to the front of the queue. a loader for the read only viewer doesn't load anything in the
+// background, boards are only loaded when they are viewed and embedded images are used where they are in the file.
+// only versioned files without a journal can be opened progressively, any other file is loaded in full when it is
+// opened
+class BoardLoader : public QObject {
+    // needed to get access to the signals and slots mechanism
+    Q_OBJECT
+// public section of the class
+public:
+    // constructor for the class
+    BoardLoader(const QString &filename, bool viewer, QObject *parent = 0);
+    // destructor for the class. any boards still loading are cancelled and waited for and any that haven't been
+    // taken are deleted
+    ~BoardLoader();
+    // function that will open the file and load the first board, or the whole whiteboard if the file can't be
+    // opened progressively. the journal of the file is returned through journal. this can be run on any thread.
+    // this returns false if the file can't be read or is malformed
+    bool open(JournalState *journal);
+    // function that will tell us if any boards of the whole whiteboard were damaged and left empty when the file
+    // couldn't be opened progressively
+    const bool damaged();
+    // function that will move the given board to the front of the queue if it hasn't been loaded yet
+    void prioritise(unsigned int index);
+    // function that will tell us if the boards after the first are being loaded in the background
+    const bool progressive();
+    // function that will return the images of the whiteboard and start loading the rest of the boards. every board
+    // other than the first is an empty image holding just its title until boardLoaded is emitted for it
+    DrawOperations **start(unsigned int *image_total, unsigned int *image_max);
+    // function that will load boards off the queue until it is empty. this is run by the tasks of the pool
+    void streamBoards();
+    // function that will hand over a board once boardLoaded has been emitted for it. a damaged board comes back
+    // empty with damaged set to true
+    DrawOperations *takeBoard(unsigned int index, bool *damaged);
+    // function that will throw away the decoded embedded images that none of the boards are using anymore
+    void trimAssets();
+    // function that will load a board for the viewer straight away. a damaged board comes back empty with damaged
+    // set to true
+    DrawOperations *viewBoard(unsigned int index, bool *damaged);
+// signals for the class
+signals:
+    // signal that a board has been loaded and can be taken
+    void boardLoaded(int index);
+// private slots of the class
+private slots:
+    // slot that passes on a board that a task has loaded. the tasks go through this so that nothing is passed on
+    // once the loader has been deleted
+    void boardReady(int index);
+// private section of the class
+private:
+    // function that will open the file progressively, loading just the first board. this returns false if the file
+    // is malformed or can't be opened progressively
+    bool openProgressive(JournalState *journal);
+    // the file being loaded, whether it is being loaded for the viewer and its data
+    QString filename;
+    bool viewer;
+    QFile file;
+    QByteArray contents;
+    WhiteboardReader reader;
+    // where each of the boards are and the images embedded in the file, which the loader holds a reference to
+    QVector<BoardEntry> directory;
+    QVector<ImageAsset *> assets;
+    // guards the queue of boards waiting to be loaded and the boards that have been loaded but not taken yet
+    QMutex mutex;
+    QList<unsigned int> queue;
+    QVector<DrawOperations *> boards;
+    // the pool of tasks loading the boards
+    QThreadPool pool;
+    // the whole whiteboard when the file couldn't be opened progressively along with its total and max images and
+    // whether any of its boards were damaged
+    DrawOperations **whiteboard;
+    unsigned int whiteboard_total, whiteboard_max;
+    bool whiteboard_damaged;
+};
+
+// class definition for the task that loads boards for a board loader. this is run on the pool of the loader
+class BoardStreamTask : public QRunnable {
+// public section of the class
+public:
+    // constructor for the class
+    BoardStreamTask(BoardLoader *loader);
+    // overridden run method that loads boards until there are none left
+    void run();
+// private section of the class
+private:
+    // the loader the boards are loaded for
+    BoardLoader *loader;
+};
+
+// class definition for the task that opens a whiteboard file with a board loader, so the file can be read while
+// the gui is being set up
+class WhiteboardOpenTask : public QRunnable {
+// public section of the class
+public:
+    // constructor for the class. whether the file was opened is written to result once the task has finished
+    WhiteboardOpenTask(BoardLoader *loader, JournalState *journal, bool *result);
+    // overridden run method that opens the file
+    void run();
+// private section of the class
+private:
+    // the loader opening the file, where its journal goes and where the result goes
+    BoardLoader *loader;
+    JournalState *journal;
+    bool *result;
+};
+
+// class definition for the task that decodes an image ahead of it first being drawn. this is run on a thread pool
+class AssetDecodeTask : public QRunnable {
+// public section of the class
+public:
+    // constructor for the class. the task holds a reference to the image until it is deleted
+    AssetDecodeTask(ImageAsset *asset);
+    // destructor for the class
+    ~AssetDecodeTask();
+    // overridden run method that decodes the image
+    void run();
+// private section of the class
+private:
+    // the image to decode
+    ImageAsset *asset;
+};
+
+// class definition for the task that loads the image format plugins before the first image needs them, so that
+// isn't paid for when the first board is drawn. this is run on a thread pool
+class PluginWarmTask : public QRunnable {
+// public section of the class
+public:
+    // overridden run method that loads the plugins
+    void run();
+};
+
+// class definition for the task that draws a board of an export and writes it to a PNG file. this is run on a
+// thread pool so that several boards are drawn and written at once, each one only taking up memory while its task
+// is running
+class BoardExportTask : public QRunnable {
+// public section of the class
+public:
+    // constructor for the class. the board is only read from so it can be part of a snapshot shared with the other
+    // tasks of the export, and must stay around until the task has finished
+    BoardExportTask(DrawOperations *board, unsigned int index, unsigned int total_images, qreal scale, const QString &filename, TaskProgress *progress);
+    // overridden run method that draws and writes the board
+    void run();
+// private section of the class
+private:
+    // private function that will draw the part of the board that starts the given number of rows down the image
+    void drawStrip(QImage &strip, int top);
+    // private function that will draw and write the board a strip at a time, for boards too big to draw at once
+    bool writeStrips(int width, int height);
+    // the board to draw, where it is in the whiteboard and how many boards the whiteboard has
+    DrawOperations *board;
+    unsigned int index;
+    unsigned int total_images;
+    // how many times 1920x1080 the board is drawn at and where it is written to
+    qreal scale;
+    QString filename;
+    // the progress of the export this board is part of
+    TaskProgress *progress;
+};
+
+// class definition for the task that draws every board of an export onto a page of a PDF. the pages are written
+// out one after the other as they are finished so memory doesn't grow with the number of boards. this is run on a
+// thread pool
+class PDFExportTask : public QRunnable {
+// public section of the class
+public:
+    // constructor for the class. the boards are only read from so they can be a snapshot, and must stay around
+    // until the task has finished
+    PDFExportTask(DrawOperations **boards, unsigned int total_images, const QString &filename, TaskProgress *progress);
+    // overridden run method that draws and writes the pages
+    void run();
+// private section of the class
+private:
+    // the boards to draw and how many there are
+    DrawOperations **boards;
+    unsigned int total_images;
+    // where the PDF is written to
+    QString filename;
+    // the progress of the export
+    TaskProgress *progress;
+};
+
+// class definition for the task that draws a board of an export into an SVG document. the shapes of the board are
+// merged into paths so the document is small enough to put in a web page. this is run on a thread pool
+class SVGExportTask : public QRunnable {
+// public section of the class
+public:
+    // constructor for the class. the board is only read from so it can be part of a snapshot shared with the other
+    // tasks of the export, and must stay around until the task has finished
+    SVGExportTask(DrawOperations *board, unsigned int index, unsigned int total_images, const QString &filename, TaskProgress *progress);
+    // overridden run method that draws and writes the board
+    void run();
+// private section of the class
+private:
+    // the board to draw, where it is in the whiteboard and how many boards the whiteboard has
+    DrawOperations *board;
+    unsigned int index;
+    unsigned int total_images;
+    // where the document is written to
+    QString filename;
+    // the progress of the export this board is part of
+    TaskProgress *progress;
+};
+
+// function prototypes
+
+// function that will return how many rows at a time an image exported at the given scale is drawn and written in
+// when it is too big to be drawn whole. this is as many as fit into the memory budget with a strip for each core
+int exportStripHeight(qreal scale);
+
+// function that will return how many threads boards should be exported on at the given scale. this is one for
+// each core unless the images being drawn at once wouldn't fit into the memory budget for exports
+int exportThreadCount(qreal scale);
+
+#endif // _BACKGROUNDTASKS_HPP
@@ -0,0 +1,524 @@
+// boardrenderer.cpp
+//
+// implements the class in boardrenderer.hpp
+
+// includes
+#include <QColor>
+#include <QFont>
+#include <QFontMetrics>
+#include <QPainterPath>
+#include <QPen>
+#include <QRectF>
+#include "boardrenderer.hpp"
+#include "constants.hpp"
+#include "imageasset.hpp"
+
+// functions
+
+// function that will tell us if the given op of the board falls entirely outside of the clip, in which case drawing it
+// would change nothing. ops whose bounds aren't known up front, like text, and everything when there is no clip are
+// never outside of it
+static bool outsideClip(DrawOperations *board, unsigned int index, const QRectF &clip) {
+    if(clip.isNull())
+        return false;
+
+    // work out the bounds of the op, with a little room around them for the pen
+    QRectF bounds;
+    unsigned int operation = board->operations[index].draw_operation;
+    if(operation == POINT_CIRCLE || operation == POINT_SQUARE || operation == POINT_X) {
+        PointOp *point = (PointOp *) &board->operations[index];
+        bounds = QRectF(point->x - (point->size / 2), point->y - (point->size / 2), point->size, point->size).adjusted(-2, -2, 2, 2);
+    } else if(operation == STRAIGHT_LINE_END) {
+        StraightLineStart *start = (StraightLineStart *) &board->operations[index - 1];
+        StraightLineEnd *end = (StraightLineEnd *) &board->operations[index];
+        qreal margin = end->size / 2 + 1;
+        bounds = QRectF(QPointF(start->x, start->y), QPointF(end->x, end->y)).normalized().adjusted(-margin, -margin, margin, margin);
+    } else if(operation == DRAW_RASTER) {
+        RasterImage *image = (RasterImage *) &board->operations[index];
+        bounds = QRectF(image->x, image->y, image->width, image->height).normalized().adjusted(-1, -1, 1, 1);
+    } else if(operation == DRAW_SVG) {
+        SVGImage *image = (SVGImage *) &board->operations[index];
+        bounds = QRectF(image->x, image->y, image->width, image->height).normalized().adjusted(-1, -1, 1, 1);
+    } else {
+        return false;
+    }
+    return !bounds.intersects(clip);
+}
+
+// constructor for the class
+BoardRenderer::BoardRenderer(const RenderOptions &options)
+: render_options(options)
+{
+}
+
+// function that will draw the white background of a board
+void BoardRenderer::drawBackground(QPainter &painter) {
+    painter.setPen(QColor(255, 255, 255));
+    painter.setBrush(QColor(255, 255, 255));
+    painter.drawRect(0, 0, 1920, 1080);
+}
+
+// function that will draw the number and title of a board along the bottom of it, as they are shown on exports
+void BoardRenderer::drawFooter(QPainter &painter, unsigned int index, unsigned int total, const QString &title) {
+    // at the bottom left of the image draw some text denoting the position of this image in the set
+    QFont tempfont(QString("Arial"), 20);
+    painter.save();
+    painter.setFont(tempfont);
+    painter.translate(32, 1052);
+    painter.setPen(QColor(0, 0, 0));
+    painter.drawText(0, 0, QString("(%1 / %2)").arg(index + 1).arg(total));
+    painter.restore();
+
+    // at the bottom middle of the image draw some text denoting the title of the image
+    painter.save();
+    painter.setFont(tempfont);
+    painter.translate(256, 1052);
+    painter.setPen(QColor(0, 0, 0));
+    painter.drawText(0, 0, title);
+    painter.restore();
+}
+
+// function that will return the options the renderer draws with
+const RenderOptions &BoardRenderer::options() {
+    return render_options;
+}
+
+// function that will draw ops [0, end) of the board through the current transform of the painter
+bool BoardRenderer::render(DrawOperations *board, QPainter &painter, unsigned int end) {
+    setRenderHints(painter);
+
+    // draw the nearest baked copy of the board if we are allowed to use them. if there is none then we start from
+    // a white background
+    bool baked = false;
+    unsigned int start = 0;
+    if(render_options.use_caches)
+        start = drawCachedOps(painter, board, end, true, &baked);
+    if(start == 0)
+        drawBackground(painter);
+
+    // replay all of the draw operations that come after the baked copy
+    drawOps(painter, board, start, end);
+    return baked;
+}
+
+// function that will draw the whole board onto the device through the given transform
+void BoardRenderer::render(DrawOperations *board, QPaintDevice *device, const QTransform &transform) {
+    QPainter painter;
+    painter.begin(device);
+    painter.setTransform(transform);
+    render(board, painter, board->total_ops);
+    painter.end();
+}
+
+// private function that will draw the nearest baked copy of ops [0, end) of the board. this is either a history
+// keyframe or the locked operations, whichever is closer to the end. when asked a new keyframe will be baked if the
+// nearest one is too far behind. this returns the index of the first operation that still needs to be replayed, which
+// is zero if nothing was drawn
+unsigned int BoardRenderer::drawCachedOps(QPainter &painter, DrawOperations *board, unsigned int end, bool make_keyframes, bool *baked) {
+    // see how much of the board is locked, the locked copy can only be used if the lock is before the end
+    unsigned int locked_end = qMin(board->locked_op, board->total_ops);
+    if(!board->locked || locked_end > end)
+        locked_end = 0;
+
+    // keyframes are rasters so can only be blitted when the painter has no transform
+    qreal ratio = painter.device()->devicePixelRatioF();
+    if(painter.transform().isIdentity()) {
+        // find the nearest keyframe at or before the end that matches the resolution of the device
+        unsigned int key = 0;
+        QImage keyframe_image;
+        QMap<unsigned int, QImage>::const_iterator keyframe = board->keyframes.upperBound(end);
+        if(keyframe != board->keyframes.constBegin()) {
+            keyframe--;
+            if(keyframe.value().devicePixelRatio() == ratio) {
+                key = keyframe.key();
+                keyframe_image = keyframe.value();
+            }
+        }
+
+        // if we are more than an interval past the nearest copy then bake a new keyframe to draw from
+        unsigned int target = keyframePosition(board, end);
+        if(make_keyframes && target > key && target > locked_end) {
+            // draw everything up to the target starting from the best copy we already have
+            QImage image((int)(1920 * ratio), (int)(1080 * ratio), QImage::Format_RGB32);
+            image.setDevicePixelRatio(ratio);
+            QPainter keyframe_painter(&image);
+            keyframe_painter.setFont(painter.font());
+            setRenderHints(keyframe_painter);
+            unsigned int start = drawCachedOps(keyframe_painter, board, target, false, NULL);
+            if(start == 0)
+                drawBackground(keyframe_painter);
+            drawOps(keyframe_painter, board, start, target);
+            keyframe_painter.end();
+
+            // store the keyframe and let the owner of the board know so it can stay within its budget
+            board->keyframes.insert(target, image);
+            key = target;
+            keyframe_image = image;
+            if(baked != NULL)
+                *baked = true;
+        }
+
+        // draw the keyframe if it is closer than the lock
+        if(key > 0 && key >= locked_end) {
+            painter.drawImage(0, 0, keyframe_image);
+            return key;
+        }
+    }
+
+    // if there is nothing locked then there is nothing baked either
+    if(locked_end == 0)
+        return 0;
+
+    // see how the painter is drawing. without a transform the raster copy can be blitted straight onto the device,
+    // otherwise the picture is replayed so that the locked operations stay sharp
+    if(painter.transform().isIdentity()) {
+        // bake the raster copy at the resolution of the device if we don't have one yet
+        if(!board->locked_raster_valid || board->locked_raster.devicePixelRatio() != ratio) {
+            board->locked_raster = QImage((int)(1920 * ratio), (int)(1080 * ratio), QImage::Format_RGB32);
+            board->locked_raster.setDevicePixelRatio(ratio);
+            QPainter raster_painter(&board->locked_raster);
+            raster_painter.setFont(painter.font());
+            setRenderHints(raster_painter);
+            drawBackground(raster_painter);
+            drawOps(raster_painter, board, 0, locked_end);
+            raster_painter.end();
+            board->locked_raster_valid = true;
+        }
+
+        // draw the baked raster
+        painter.drawImage(0, 0, board->locked_raster);
+    } else {
+        // record the picture copy if we don't have one yet
+        if(!board->locked_picture_valid) {
+            QPainter picture_painter(&board->locked_picture);
+            picture_painter.setFont(painter.font());
+            setRenderHints(picture_painter);
+            drawBackground(picture_painter);
+            drawOps(picture_painter, board, 0, locked_end);
+            picture_painter.end();
+            board->locked_picture_valid = true;
+        }
+
+        // replay the baked picture
+        painter.drawPicture(0, 0, board->locked_picture);
+    }
+
+    // everything up to the lock has been drawn
+    return locked_end;
+}
+
+// private function that will draw a freehand line. this will return an updated index once the line is drawn.
+// assumes that the index is on a line start, this is meant an an optimisation to reduce the amount of if statements
+// and function calls used to draw a freehand line. the line will not be followed past the end index, and segments
+// that fall entirely outside of the clip are skipped
+unsigned int BoardRenderer::drawFreehandLine(QPainter &painter, DrawOperations *board, unsigned int index, unsigned int end, const QRectF &clip) {
+    // get a reference to the line start
+    LineStart *start = (LineStart *) &board->operations[index++];
+    int old_x = start->x;
+    int old_y = start->y;
+
+    // take a reference to the colour and the size as these will not change throughout the line draw
+    unsigned int p_colour = start->colour;
+    unsigned int size = start->size;
+
+    // set the pen with the right thickness and the brush
+    QPen pen;
+    pen.setColor(p_colour);
+    pen.setWidth(size);
+    painter.setPen(pen);
+    painter.setBrush(QColor(p_colour));
+
+    // the clip grown by the thickness of the line, so a segment can be skipped by its end points alone
+    bool culling = !clip.isNull();
+    qreal margin = size / 2 + 1;
+    QRectF grown = clip.adjusted(-margin, -margin, margin, margin);
+
+    // while we are still on line points keep drawing the line
+    while(index < end && board->operations[index].draw_operation == LINE_POINT) {
+        // get a reference to the current line point and pull out the point
+        LinePoint *current = (LinePoint *) &board->operations[index];
+        int new_x = current->x;
+        int new_y = current->y;
+
+        // draw the line segment move the new data into the old and move onto the next point
+        if(!culling || grown.intersects(QRectF(QPointF(old_x, old_y), QPointF(new_x, new_y)).normalized().adjusted(-1, -1, 1, 1)))
+            painter.drawLine(old_x, old_y, new_x, new_y);
+        old_x = new_x;
+        old_y = new_y;
+        index++;
+    }
+
+    // if we have the end of the line so pull this out and draw the end of the line
+    if(index < end && board->operations[index].draw_operation == LINE_END) {
+        LineEnd *end = (LineEnd *) &board->operations[index];
+        painter.drawLine(old_x, old_y, end->x, end->y);
+    }
+
+    // return the updated index
+    return index;
+}
+
+// private function that will draw a freehand line as a single path, so a vector export holds one element for the
+// whole line rather than one for every segment of it. the line will not be followed past the end index
+unsigned int BoardRenderer::drawFreehandPath(QPainter &painter, DrawOperations *board, unsigned int index, unsigned int end) {
+    // start the path at the line start
+    LineStart *start = (LineStart *) &board->operations[index++];
+    QPainterPath path(QPointF(start->x, start->y));
+
+    // add on each of the line points and the end of the line if we have it
+    while(index < end && board->operations[index].draw_operation == LINE_POINT) {
+        LinePoint *current = (LinePoint *) &board->operations[index];
+        path.lineTo(current->x, current->y);
+        index++;
+    }
+    if(index < end && board->operations[index].draw_operation == LINE_END) {
+        LineEnd *end = (LineEnd *) &board->operations[index];
+        path.lineTo(end->x, end->y);
+    }
+
+    // draw the path with the thickness of the line. the path is only stroked as a line isn't filled in
+    QPen pen(QColor(start->colour));
+    pen.setWidth(start->size);
+    painter.setPen(pen);
+    painter.setBrush(Qt::NoBrush);
+    painter.drawPath(path);
+
+    // return the updated index
+    return index;
+}
+
+// private function that will replay the draw operations [start, end) of the board
+void BoardRenderer::drawOps(QPainter &painter, DrawOperations *board, unsigned int start, unsigned int end) {
+    // when the painter is clipped, as it is when a large export is drawn a strip at a time, the ops that fall
+    // entirely outside of the clip are skipped rather than drawn for nothing
+    QRectF clip;
+    if(painter.hasClipping())
+        clip = painter.clipBoundingRect();
+
+    // go through all of the draw operations that are in the range
+    for(unsigned int i = start; i < end; i++) {
+        // go through each of the draw ops and perform the necessary action. shapes are merged into paths if asked
+        unsigned int operation = board->operations[i].draw_operation;
+        if(render_options.merge_shapes && (operation == POINT_CIRCLE || operation == POINT_SQUARE || operation == POINT_X)) {
+            i = drawPointRun(painter, board, i, end);
+        } else if(render_options.merge_shapes && operation == STRAIGHT_LINE_END) {
+            i = drawStraightLineRun(painter, board, i, end);
+        } else if(render_options.merge_shapes && operation == LINE_START) {
+            i = drawFreehandPath(painter, board, i, end);
+        } else if(outsideClip(board, i, clip)) {
+            continue;
+        } else if(board->operations[i].draw_operation == POINT_CIRCLE) {
+            drawPointCircle(painter, board, i);
+        } else if(board->operations[i].draw_operation == POINT_SQUARE) {
+            drawPointSquare(painter, board, i);
+        } else if(board->operations[i].draw_operation == POINT_X) {
+            drawPointX(painter, board, i);
+        } else if(board->operations[i].draw_operation == STRAIGHT_LINE_END) {
+            drawStraightLine(painter, board, i);
+        } else if(board->operations[i].draw_operation == LINE_START) {
+            i = drawFreehandLine(painter, board, i, end, clip);
+        } else if(board->operations[i].draw_operation == DRAW_TEXT) {
+            drawText(painter, board, i);
+        } else if(board->operations[i].draw_operation == DRAW_RASTER) {
+            drawRasterImage(painter, board, i);
+        } else if(board->operations[i].draw_operation == DRAW_SVG) {
+            drawSVGImage(painter, board, i);
+        }
+    }
+}
+
+// private function that will draw a point circle, and an index into the board that contains the data
+void BoardRenderer::drawPointCircle(QPainter &painter, DrawOperations *board, unsigned int index) {
+    // get the circle point structure set the pen and draw the point
+    PointCircle *temp = (PointCircle *) &board->operations[index];
+    painter.setPen(QColor(temp->colour));
+    painter.setBrush(QColor(temp->colour));
+    painter.drawEllipse(temp->x - (temp->size / 2), temp->y - (temp->size / 2), temp->size, temp->size);
+}
+
+// private function that will draw the run of points starting at the index that have the same type, colour and size
+// as a single path. the points are filled by winding so any that overlap don't cancel each other out
+unsigned int BoardRenderer::drawPointRun(QPainter &painter, DrawOperations *board, unsigned int index, unsigned int end) {
+    PointOp *first = (PointOp *) &board->operations[index];
+    QPainterPath path;
+    path.setFillRule(Qt::WindingFill);
+
+    // add each point of the run onto the path the same way it would be drawn on its own
+    unsigned int last = index;
+    for(unsigned int i = index; i < end; i++) {
+        PointOp *point = (PointOp *) &board->operations[i];
+        if(point->draw_operation != first->draw_operation || point->colour != first->colour || point->size != first->size)
+            break;
+        if(point->draw_operation == POINT_CIRCLE) {
+            path.addEllipse(point->x - (point->size / 2), point->y - (point->size / 2), point->size, point->size);
+        } else if(point->draw_operation == POINT_SQUARE) {
+            path.addRect(point->x - (point->size / 2), point->y - (point->size / 2), point->size, point->size);
+        } else {
+            path.moveTo(point->x - (point->size / 2), point->y - (point->size / 2));
+            path.lineTo(point->x + (point->size / 2), point->y + (point->size / 2));
+            path.moveTo(point->x + (point->size / 2), point->y - (point->size / 2));
+            path.lineTo(point->x - (point->size / 2), point->y + (point->size / 2));
+        }
+        last = i;
+    }
+
+    // x points are two lines with a thicker pen, the others are filled in
+    if(first->draw_operation == POINT_X) {
+        QPen pen(QColor(first->colour));
+        pen.setWidth(2);
+        painter.setPen(pen);
+        painter.setBrush(Qt::NoBrush);
+    } else {
+        painter.setPen(QColor(first->colour));
+        painter.setBrush(QColor(first->colour));
+    }
+    painter.drawPath(path);
+    return last;
+}
+
+// private function that will draw a point square, and an index into the board that contains the data
+void BoardRenderer::drawPointSquare(QPainter &painter, DrawOperations *board, unsigned int index) {
+    // get the square point structure set teh pen and draw the point
+    PointSquare *temp = (PointSquare *) &board->operations[index];
+    painter.setPen(QColor(temp->colour));
+    painter.setBrush(QColor(temp->colour));
+    painter.drawRect(temp->x - (temp->size / 2), temp->y - (temp->size / 2), temp->size, temp->size);
+}
+
+// private function that will draw a point x
+void BoardRenderer::drawPointX(QPainter &painter, DrawOperations *board, unsigned int index) {
+    // get the x point structure set teh pen and draw the point
+    PointX *temp = (PointX *) &board->operations[index];
+    QPen pen(QColor(temp->colour));
+    pen.setWidth(2);
+    painter.setPen(pen);
+    painter.setBrush(QColor(temp->colour));
+
+    // draw the two lines to make the x point
+    painter.drawLine(temp->x - (temp->size / 2), temp->y - (temp->size / 2), temp->x + (temp->size / 2), temp->y + (temp->size / 2));
+    painter.drawLine(temp->x + (temp->size / 2), temp->y - (temp->size / 2), temp->x - (temp->size / 2), temp->y + (temp->size / 2));
+}
+
+// private function that will draw a raster image
+void BoardRenderer::drawRasterImage(QPainter &painter, DrawOperations *board, unsigned int index) {
+    // get a reference to the image for drawing
+    RasterImage *temp = (RasterImage *) &board->operations[index];
+
+    // draw the image on the board by first specifiing the rects that match the source size and the request destination size
+    QImage *raster = assetRaster(temp->asset);
+    QRectF source(0, 0, raster->width(), raster->height());
+    QRectF destination(temp->x, temp->y, temp->width, temp->height);
+    painter.drawImage(destination, *raster, source);
+}
+
+// private function that will draw a straight line
+void BoardRenderer::drawStraightLine(QPainter &painter, DrawOperations *board, unsigned int index) {
+    // get references to the start and end of the straight line
+    StraightLineStart *start = (StraightLineStart *) &board->operations[index - 1];
+    StraightLineEnd *end = (StraightLineEnd *) &board->operations[index];
+
+    // set teh pen with the right thickness and the brush
+    QPen pen(QColor(end->colour));
+    pen.setWidth(end->size);
+    painter.setPen(pen);
+    painter.setBrush(QColor(end->colour));
+
+    // draw the line
+    painter.drawLine(start->x, start->y, end->x, end->y);
+}
+
+// private function that will draw the run of straight lines ending at the index that have the same colour and
+// thickness as a single path. each line is a start followed by its end, so the next line ends two ops further on
+unsigned int BoardRenderer::drawStraightLineRun(QPainter &painter, DrawOperations *board, unsigned int index, unsigned int end) {
+    StraightLineEnd *first = (StraightLineEnd *) &board->operations[index];
+    QPainterPath path;
+
+    // add each line of the run onto the path
+    unsigned int last = index;
+    for(unsigned int i = index; i < end; i += 2) {
+        StraightLineStart *start = (StraightLineStart *) &board->operations[i - 1];
+        StraightLineEnd *line_end = (StraightLineEnd *) &board->operations[i];
+        if(start->draw_operation != STRAIGHT_LINE_START || line_end->draw_operation != STRAIGHT_LINE_END ||
+            line_end->colour != first->colour || line_end->size != first->size)
+            break;
+        path.moveTo(start->x, start->y);
+        path.lineTo(line_end->x, line_end->y);
+        last = i;
+    }
+
+    // draw the path with the thickness of the lines
+    QPen pen(QColor(first->colour));
+    pen.setWidth(first->size);
+    painter.setPen(pen);
+    painter.setBrush(Qt::NoBrush);
+    painter.drawPath(path);
+    return last;
+}
+
+// private function that will draw an SVG image
+void BoardRenderer::drawSVGImage(QPainter &painter, DrawOperations *board, unsigned int index) {
+    // get a reference to the image for drawing
+    SVGImage *temp = (SVGImage *) &board->operations[index];
+
+    // draw the image on the board by first specifiing the rects that match the source size and the request destination size
+    QRectF destination(temp->x, temp->y, temp->width, temp->height);
+    renderAssetSVG(temp->asset, &painter, destination);
+}
+
+// private function that will draw text
+void BoardRenderer::drawText(QPainter &painter, DrawOperations *board, unsigned int index) {
+    // get a reference to the text for drawing
+    Text *temp = (Text *) &board->operations[index];
+
+    // get the font metrics and determine the width of the string
+    QFontMetrics metrics = painter.fontMetrics();
+    int width = metrics.horizontalAdvance(*temp->string);
+    int height = metrics.height();
+
+    // we will need to save, translate to the position, and rotate by the given angle
+    painter.save();
+    painter.translate(temp->x, temp->y);
+    painter.rotate(temp->rotation);
+
+    // draw the text on the board
+    QFont tempfont("Arial", temp->size);
+    painter.setPen(QColor(temp->colour));
+    painter.setFont(tempfont);
+    painter.drawText(-width, height / 2, *temp->string);
+
+    // restore our painter state
+    painter.restore();
+}
+
+// private function that will return where the keyframe for drawing up to the given op should be baked. this is the
+// last multiple of the keyframe interval before the end, moved forward so that it doesn't split a freehand line.
+// zero is returned if there is no such place
+unsigned int BoardRenderer::keyframePosition(DrawOperations *board, unsigned int end) {
+    // start from the last multiple of the interval
+    unsigned int position = (end / KEYFRAME_INTERVAL) * KEYFRAME_INTERVAL;
+    if(position == 0)
+        return 0;
+
+    // step past any freehand line that the position would cut through
+    while(position < end && (board->operations[position].draw_operation == LINE_POINT || board->operations[position].draw_operation == LINE_END))
+        position++;
+
+    // a keyframe at the end of the board can't be in the middle of a line that is still being drawn
+    if(position == board->total_ops) {
+        unsigned int last = board->operations[position - 1].draw_operation;
+        if(last == LINE_START || last == LINE_POINT)
+            return 0;
+    } else if(board->operations[position].draw_operation == LINE_POINT || board->operations[position].draw_operation == LINE_END) {
+        return 0;
+    }
+    return position;
+}
+
+// private function that will set the render hints of the painter from the options. hints are only ever turned on
+// so whatever the painter was already doing, like antialiasing text by default, is left alone
+void BoardRenderer::setRenderHints(QPainter &painter) {
+    if(render_options.antialias)
+        painter.setRenderHint(QPainter::Antialiasing);
+    if(render_options.smooth_images)
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+}
@@ -0,0 +1,96 @@
+#ifndef _BOARDRENDERER_HPP
+#define _BOARDRENDERER_HPP
+
+// boardrenderer.hpp
+//
+// class that draws the operations of a board onto any paint device. the renderer holds nothing but how it is to
+// draw and never changes once it is made, so the whiteboard, exports and previews can share one and any number of
+// boards can be drawn with it at once on different threads
+
+// includes
+#include <QPaintDevice>
+#include <QPainter>
+#include <QRectF>
+#include <QString>
+#include <QTransform>
+#include "drawoperations.hpp"
+
+// structure describing how a board is drawn
+struct RenderOptions {
+    bool antialias; // draw the points and lines with antialiasing
+    bool smooth_images; // scale raster images smoothly rather than picking the nearest pixel
+    bool use_caches; // draw from and bake into the keyframes and locked copies held by the board. these aren't
+                     // guarded so this can only be used by whoever owns the board, which is the gui thread for the
+                     // images of the whiteboard. without it the board is only ever read from
+    bool merge_shapes; // draw each freehand line, and each run of points or straight lines that look the same, as a
+                       // single path. this makes for far fewer elements in vector exports
+};
+
+// the images are drawn on screen as they always have been, without antialiasing, and the keyframes and locked copies
+// of each image are used to keep redrawing them quick. exports are drawn the same way but never touch the copies
+// held by the images, so they can be drawn on any thread while the images are being drawn on screen. vector
+// exports also merge the shapes of the images into paths
+const RenderOptions SCREEN_RENDER_OPTIONS = {false, false, true, false};
+const RenderOptions EXPORT_RENDER_OPTIONS = {false, false, false, false};
+const RenderOptions VECTOR_RENDER_OPTIONS = {false, false, false, true};
+
+// class definition
+class BoardRenderer {
+// public section of the class
+public:
+    // constructor for the class. the renderer draws with the given options
+    BoardRenderer(const RenderOptions &options);
+    // function that will draw the white background of a board
+    void drawBackground(QPainter &painter);
+    // function that will draw the number and title of a board along the bottom of it, as they are shown on exports
+    void drawFooter(QPainter &painter, unsigned int index, unsigned int total, const QString &title);
+    // function that will return the options the renderer draws with
+    const RenderOptions &options();
+    // function that will draw ops [0, end) of the board through the current transform of the painter. this returns
+    // true if a new keyframe was baked into the board, in which case its owner may want to trim them
+    bool render(DrawOperations *board, QPainter &painter, unsigned int end);
+    // function that will draw the whole board onto the device through the given transform
+    void render(DrawOperations *board, QPaintDevice *device, const QTransform &transform);
+// private section of the class
+private:
+    // private function that will draw the nearest baked copy of ops [0, end) of the board, baking a new keyframe if
+    // asked, and return the index of the first operation that still needs to be replayed
+    unsigned int drawCachedOps(QPainter &painter, DrawOperations *board, unsigned int end, bool make_keyframes, bool *baked);
+    // private function that will draw a freehand line. this will return an updated index once the line is drawn.
+    // assumes that the index is on a line start, the line will not be followed past the end index. segments
+    // outside of the clip, given in board coordinates, are skipped unless the clip is null
+    unsigned int drawFreehandLine(QPainter &painter, DrawOperations *board, unsigned int index, unsigned int end, const QRectF &clip);
+    // private function that will draw a freehand line as a single path. this works the same way as drawing a
+    // freehand line, returning the updated index once the line is drawn
+    unsigned int drawFreehandPath(QPainter &painter, DrawOperations *board, unsigned int index, unsigned int end);
+    // private function that will replay the draw operations [start, end) of the board
+    void drawOps(QPainter &painter, DrawOperations *board, unsigned int start, unsigned int end);
+    // private function that will draw a point circle, and an index into the board that contains the data
+    void drawPointCircle(QPainter &painter, DrawOperations *board, unsigned int index);
+    // private function that will draw a point square, and an index into the board that contains the data
+    void drawPointSquare(QPainter &painter, DrawOperations *board, unsigned int index);
+    // private function that will draw the run of points starting at the index that have the same type, colour and
+    // size as a single path. this returns the index of the last point in the run, which won't be past the end index
+    unsigned int drawPointRun(QPainter &painter, DrawOperations *board, unsigned int index, unsigned int end);
+    // private function that will draw a point x
+    void drawPointX(QPainter &painter, DrawOperations *board, unsigned int index);
+    // private function that will draw a raster image
+    void drawRasterImage(QPainter &painter, DrawOperations *board, unsigned int index);
+    // private function that will draw a straight line assumes the current index is a straight line end
+    void drawStraightLine(QPainter &painter, DrawOperations *board, unsigned int index);
+    // private function that will draw the run of straight lines ending at the index that have the same colour and
+    // thickness as a single path. this returns the index of the end of the last line in the run
+    unsigned int drawStraightLineRun(QPainter &painter, DrawOperations *board, unsigned int index, unsigned int end);
+    // private function that will draw an SVG image
+    void drawSVGImage(QPainter &painter, DrawOperations *board, unsigned int index);
+    // private function that will draw text
+    void drawText(QPainter &painter, DrawOperations *board, unsigned int index);
+    // private function that will return where the keyframe for drawing ops [0, end) of the board should be baked
+    unsigned int keyframePosition(DrawOperations *board, unsigned int end);
+    // private function that will set the render hints of the painter from the options
+    void setRenderHints(QPainter &painter);
+    // how the renderer draws
+    RenderOptions render_options;
+};
+
+#endif // _BOARDRENDERER_HPP
@@ -0,0 +1,114 @@
+// checksum.cpp
+//
+// implements everything described in checksum.hpp
+
+// includes
+#include <cstring>
+#include "checksum.hpp"
+
+// the crc32c instructions of SSE4.2 are used on x86 when the processor has them, which is checked for when the
+// first checksum is taken. arm only has them if the build targets them so they are picked at compile time there
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define CRC32C_SSE42
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARM
+#endif
+
+// the reversed castagnoli polynomial
+static const unsigned int CRC32C_POLYNOMIAL = 0x82F63B78;
+
+// structure holding the lookup table for the checksum. the table is filled in the first time it is used
+struct CRC32CTable {
+    unsigned int entries[256];
+
+    // fill in the crc of every possible byte
+    CRC32CTable() {
+        for(unsigned int i = 0; i < 256; i++) {
+            unsigned int crc = i;
+            for(unsigned int bit = 0; bit < 8; bit++)
+                crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+            entries[i] = crc;
+        }
+    }
+};
+
+// functions
+
+// function that will run the data through the lookup table a byte at a time. this is used wherever the processor
+// can't take the checksum itself
+static unsigned int crc32cTable(const uchar *data, qint64 length, unsigned int crc) {
+    // the table is only built once, even if several threads get here at the same time
+    static const CRC32CTable table;
+    for(qint64 i = 0; i < length; i++)
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef CRC32C_SSE42
+// function that will take the checksum with the SSE4.2 crc32 instruction, eight bytes at a time where it can. this
+// is built for SSE4.2 on its own so the rest of the application still runs on processors without it
+__attribute__((target("sse4.2")))
+static unsigned int crc32cSSE42(const uchar *data, qint64 length, unsigned int crc) {
+#ifdef __x86_64__
+    quint64 wide_crc = crc;
+    while(length >= 8) {
+        quint64 value;
+        memcpy(&value, data, sizeof(quint64));
+        wide_crc = _mm_crc32_u64(wide_crc, value);
+        data += 8;
+        length -= 8;
+    }
+    crc = (unsigned int) wide_crc;
+#endif
+    while(length >= 4) {
+        unsigned int value;
+        memcpy(&value, data, sizeof(unsigned int));
+        crc = _mm_crc32_u32(crc, value);
+        data += 4;
+        length -= 4;
+    }
+    while(length > 0) {
+        crc = _mm_crc32_u8(crc, *data);
+        data++;
+        length--;
+    }
+    return crc;
+}
+#endif
+
+#ifdef CRC32C_ARM
+// function that will take the checksum with the armv8 crc32c instructions, eight bytes at a time where it can
+static unsigned int crc32cARM(const uchar *data, qint64 length, unsigned int crc) {
+    while(length >= 8) {
+        quint64 value;
+        memcpy(&value, data, sizeof(quint64));
+        crc = __crc32cd(crc, value);
+        data += 8;
+        length -= 8;
+    }
+    while(length > 0) {
+        crc = __crc32cb(crc, *data);
+        data++;
+        length--;
+    }
+    return crc;
+}
+#endif
+
+// function that will return the crc32c of the given data. a previous crc can be passed in to carry on a checksum
+// across several blocks of data. the processor takes the checksum itself if it can, otherwise a lookup table is used
+unsigned int crc32c(const uchar *data, qint64 length, unsigned int crc) {
+    crc = ~crc;
+#if defined(CRC32C_SSE42)
+    // the processor is only asked once whether it has SSE4.2
+    static const bool sse42 = __builtin_cpu_supports("sse4.2");
+    crc = sse42 ? crc32cSSE42(data, length, crc) : crc32cTable(data, length, crc);
+#elif defined(CRC32C_ARM)
+    crc = crc32cARM(data, length, crc);
+#else
+    crc = crc32cTable(data, length, crc);
+#endif
+    return ~crc;
+}
@@ -0,0 +1,18 @@
+#ifndef _CHECKSUM_HPP
+#define _CHECKSUM_HPP
+
+// checksum.hpp
+//
+// describes the checksum used to detect damage to the boards and other sections of a whiteboard file. this is
+// the crc32c (castagnoli) checksum, which is taken with the crc32c instructions of the processor when it has them
+
+// includes
+#include <QtGlobal>
+
+// function prototypes
+
+// function that will return the crc32c of the given data. a previous crc can be passed in to carry on a checksum
+// across several blocks of data
+unsigned int crc32c(const uchar *data, qint64 length, unsigned int crc = 0);
+
+#endif // _CHECKSUM_HPP
@@ -5,6 +5,9 @@
 //
 // defines all of the constants for our application
 
+// includes
+#include <QtGlobal>
+
 // constants for all of our operations
 const unsigned int OP_POINT_CIRCLE = 0;
 const unsigned int OP_POINT_X = 1;
@@ -29,4 +32,112 @@ const unsigned int DRAW_TEXT = 9;
 const unsigned int DRAW_RASTER = 10;
 const unsigned int DRAW_SVG = 11;
 
+// constants for the history keyframes of a board. a keyframe is baked roughly every KEYFRAME_INTERVAL ops
+// and no more than MAX_KEYFRAMES of them are kept across all of the boards
+const unsigned int KEYFRAME_INTERVAL = 512;
+const unsigned int MAX_KEYFRAMES = 16;
+
+// constants for the whiteboard file format. WBD_MAGIC is the characters WBD2 read as an unsigned int and is what
+// tells a versioned file apart from the original format, which starts straight away with the number of images
+const unsigned int WBD_MAGIC = 0x32444257;
+const unsigned int WBD_VERSION = 5;
+const unsigned int WBD_HEADER_SIZE = 4 * sizeof(unsigned int);
+// each directory entry holds the offset, size, checksum and flags of its board and the checksum of its title
+// followed by the title. this is the size of an entry with an empty title. files before WBD_TITLE_CHECKSUMS have no
+// checksum of the title
+const unsigned int WBD_DIRECTORY_ENTRY_SIZE = sizeof(quint64) + 5 * sizeof(unsigned int);
+const unsigned int WBD_TITLE_CHECKSUMS = 5;
+
+// flags describing the whole whiteboard file. WBD_EMBEDDED_ASSETS means that every image used by the boards is
+// embedded in the file. the directory is then followed by the number of images and an asset table entry for each
+// one, which holds the offset, size, checksum and draw operation of the image, the sha1 hash of its bytes and the
+// path it was loaded from. this is the size of an entry with an empty path. the bytes of the images come after
+// the table, each image only being stored once however many ops use it
+const unsigned int WBD_EMBEDDED_ASSETS = 1;
+const unsigned int ASSET_HASH_SIZE = 20;
+const unsigned int WBD_ASSET_ENTRY_SIZE = sizeof(quint64) + 4 * sizeof(unsigned int) + ASSET_HASH_SIZE;
+
+// WBD_PREVIEWS means that the header is followed by a section of small JPEG previews, so a file can be shown
+// without loading any of its boards. the section starts with its size, not counting the size itself, and then
+// holds the size and bytes of a cover image followed by the size and bytes of a thumbnail for each board. a
+// preview with no bytes was never made. the directory comes straight after the section
+const unsigned int WBD_PREVIEWS = 2;
+const int THUMBNAIL_WIDTH = 192;
+const int THUMBNAIL_HEIGHT = 108;
+const int COVER_WIDTH = 480;
+const int COVER_HEIGHT = 270;
+const int PREVIEW_QUALITY = 70;
+
+// flags describing how each board is stored in a whiteboard file. BOARD_DELTA_STROKES means that freehand lines
+// may be stored as a FILE_STROKE op, which is a start point followed by the zig-zag varint differences between
+// each point. FILE_STROKE is only ever used in files and never appears in the draw operations of a board
+const unsigned int BOARD_DELTA_STROKES = 1;
+const unsigned int FILE_STROKE = 64;
+
+// BOARD_COMPRESSED means that the board starts with a small header of the codec, the level and the size of the
+// uncompressed board, followed by the compressed board. the only codec is zlib through qCompress
+const unsigned int BOARD_COMPRESSED = 2;
+const unsigned int COMPRESSION_ZLIB = 1;
+const unsigned int COMPRESSION_HEADER_SIZE = 3 * sizeof(unsigned int);
+const int DEFAULT_COMPRESSION_LEVEL = 6;
+
+// BOARD_EMBEDDED_ASSETS means that raster and svg ops hold the id of their image, which is where it is in the
+// asset table, rather than the path to it
+const unsigned int BOARD_EMBEDDED_ASSETS = 4;
+
+// constants for the journal that is appended to a whiteboard file after its boards. each save adds a batch made
+// up of a header of JOURNAL_MAGIC, the length of the batch and its crc32c followed by the records of the batch.
+// inserts and deletes of images hold the index of the image, updates hold the index of the image, how many of
+// its operations are kept, the operations added after them, its lock and its title. files with embedded images
+// add new images to the asset table with a record holding the id, draw operation, size, hash and path of the image
+// followed by its bytes
+const unsigned int JOURNAL_MAGIC = 0x4C4E524A;
+const unsigned int JOURNAL_BATCH_HEADER_SIZE = 3 * sizeof(unsigned int);
+const unsigned int JOURNAL_INSERT = 1;
+const unsigned int JOURNAL_DELETE = 2;
+const unsigned int JOURNAL_UPDATE = 3;
+const unsigned int JOURNAL_ASSET = 4;
+
+// an image keeps track of what is in two journals, the one of the file the user saves to and the one of the
+// recovery file that is autosaved to
+const unsigned int JOURNAL_SAVE = 0;
+const unsigned int JOURNAL_AUTOSAVE = 1;
+const unsigned int TOTAL_JOURNALS = 2;
+
+// once the journal is bigger than this many bytes, and bigger than half of the boards before it, the whole file
+// is rewritten JOURNAL_COMPACT_DELAY milliseconds after the save that took it past that size
+const qint64 JOURNAL_COMPACT_SIZE = 262144;
+const int JOURNAL_COMPACT_DELAY = 5000;
+
+// constants for saving and exporting away from the gui thread. the progress of a task is checked every
+// TASK_TIMER_INTERVAL milliseconds. boards are exported on as many threads as there are cores, as long as the
+// images being drawn on them at once fit into EXPORT_MEMORY_BUDGET bytes
+const int TASK_TIMER_INTERVAL = 20;
+const qint64 EXPORT_MEMORY_BUDGET = 268435456;
+
+// boards can be exported at up to EXPORT_MAX_SCALE times 1920x1080. a board is 1920x1080 at EXPORT_BASE_DPI, so
+// exporting at a given dpi scales it by dpi / EXPORT_BASE_DPI and keeps the size it is printed at. each of the
+// EXPORT_RESOLUTION_NAMES is exported at the matching one of the EXPORT_RESOLUTION_SCALES
+const qreal EXPORT_MAX_SCALE = 8;
+const qreal EXPORT_BASE_DPI = 96;
+const unsigned int TOTAL_EXPORT_RESOLUTIONS = 4;
+const char * const EXPORT_RESOLUTION_NAMES[TOTAL_EXPORT_RESOLUTIONS] = {"1080p", "1440p", "4K", "8K"};
+const qreal EXPORT_RESOLUTION_SCALES[TOTAL_EXPORT_RESOLUTIONS] = {1, 4.0 / 3, 2, 4};
+
+// exported images bigger than EXPORT_TILE_THRESHOLD bytes, which is a 4K image, are drawn and written in strips
+// so memory stays bounded however large they are. the strips are sized to fit into the memory budget for exports
+// but are never fewer than EXPORT_TILE_HEIGHT rows
+const qint64 EXPORT_TILE_THRESHOLD = 33177600;
+const int EXPORT_TILE_HEIGHT = 256;
+
+// constants for the autosave. the whiteboard is autosaved to AUTOSAVE_FILENAME in the cache directory every
+// autosave/interval seconds from the settings, which is AUTOSAVE_DEFAULT_INTERVAL if it isn't set. an interval of
+// 0 turns the autosave off
+const char * const AUTOSAVE_FILENAME = "recovery.wbd";
+const int AUTOSAVE_DEFAULT_INTERVAL = 60;
+
+// constants for the read only viewer. boards are only parsed out of the file when they are viewed and the last
+// VIEWER_CACHED_BOARDS boards viewed are kept, anything older is thrown away until it is viewed again
+const int VIEWER_CACHED_BOARDS = 8;
+
 #endif // __CONSTANTS_HPP
@@ -4,33 +4,97 @@
 
 // includes
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include "constants.hpp"
 #include "drawoperations.hpp"
 
+// function that will allocate a new block of storage for draw operations that is owned by the given object
+static OpStorage *createStorage(unsigned int max_ops, DrawOperations *owner) {
+    OpStorage *storage = new OpStorage();
+    storage->operations = new DrawOp[max_ops];
+    storage->max_ops = max_ops;
+    storage->used_ops = 0;
+    storage->ref_count.storeRelease(1);
+    storage->owner = owner;
+    return storage;
+}
+
+// function that will free the heap data held by a range of draw operations
+static void releaseOps(DrawOp *operations, unsigned int start, unsigned int end) {
+    for(unsigned int i = start; i < end; i++) {
+        if(operations[i].draw_operation == DRAW_TEXT)
+            delete operations[i].text.string;
+        else if(operations[i].draw_operation == DRAW_RASTER)
+            releaseImageAsset(operations[i].raster_image.asset);
+        else if(operations[i].draw_operation == DRAW_SVG)
+            releaseImageAsset(operations[i].svg_image.asset);
+    }
+}
+
+// function that will take our own references to the heap data of a range of draw operations that has been copied
+// out of a block that is still in use elsewhere
+static void retainOps(DrawOp *operations, unsigned int start, unsigned int end) {
+    for(unsigned int i = start; i < end; i++) {
+        if(operations[i].draw_operation == DRAW_TEXT)
+            operations[i].text.string = new QString(*operations[i].text.string);
+        else if(operations[i].draw_operation == DRAW_RASTER)
+            retainImageAsset(operations[i].raster_image.asset);
+        else if(operations[i].draw_operation == DRAW_SVG)
+            retainImageAsset(operations[i].svg_image.asset);
+    }
+}
+
+// function that will drop a reference to a block of storage and free it along with its heap data once
+// nothing is using it anymore
+static void releaseStorage(OpStorage *storage) {
+    if(storage->ref_count.deref())
+        return;
+    releaseOps(storage->operations, 0, storage->used_ops);
+    delete [] storage->operations;
+    delete storage;
+}
+
 // default constructor for the class that will initialise a 4K sized draw operations object
 DrawOperations::DrawOperations()
-: total_ops(0), max_ops(1024), title(QString("")), locked(false), locked_op(0)
+: total_ops(0), max_ops(1024), title(QString("")), locked(false), locked_op(0), locked_raster_valid(false), locked_picture_valid(false), thumbnail_ops(0), thumbnail_valid(false)
 {
-    // allocate the array of draw operations
-    operations = new DrawOp[max_ops];
+    // allocate the block of draw operations
+    storage = createStorage(max_ops, this);
+    operations = storage->operations;
+    clearJournalMarks();
 }
 
 DrawOperations::DrawOperations(const unsigned int max_ops)
-: total_ops(0), max_ops(max_ops), title(QString("")), locked(false), locked_op(0)
+: total_ops(0), max_ops(max_ops), title(QString("")), locked(false), locked_op(0), locked_raster_valid(false), locked_picture_valid(false), thumbnail_ops(0), thumbnail_valid(false)
 {
-    // allocate the array of draw operations
-    operations = new DrawOp[max_ops];
+    // allocate the block of draw operations
+    storage = createStorage(max_ops, this);
+    operations = storage->operations;
+    clearJournalMarks();
+}
+
+// constructor that will make a snapshot of the source that shares its operations along with everything else
+DrawOperations::DrawOperations(DrawOperations *source)
+: total_ops(source->total_ops), max_ops(source->max_ops), title(source->title), operations(source->operations), storage(source->storage), locked(source->locked), locked_op(source->locked_op), locked_raster(source->locked_raster), locked_picture(source->locked_picture), locked_raster_valid(source->locked_raster_valid), locked_picture_valid(source->locked_picture_valid), keyframes(source->keyframes), thumbnail(source->thumbnail), thumbnail_ops(source->thumbnail_ops), thumbnail_valid(source->thumbnail_valid)
+{
+    // take a reference on the shared block and pick up what the saved files hold
+    storage->ref_count.ref();
+    for(unsigned int i = 0; i < TOTAL_JOURNALS; i++)
+        journal_marks[i] = source->journal_marks[i];
 }
 
 // destructor for the class
 DrawOperations::~DrawOperations() {
-    // delete all of our arrays
-    delete operations;
+    // let go of our operations, they are only deleted if no duplicate is still using them
+    releaseStorage(storage);
 }
 
 // adds draw data for the start point of a freehand line
 void DrawOperations::addDrawFreehandStart(int x, int y, unsigned int colour, int draw_size) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
     // set the current draw operation to a freehand line point and fill in the data
     LineStart *temp = (LineStart *) &operations[total_ops];
     temp->draw_operation = LINE_START;
@@ -41,12 +105,16 @@ void DrawOperations::addDrawFreehandStart(int x, int y, unsigned int colour, int
 
     // update the total ops after we are done if we hit the max size then we need to up the array size
     total_ops++;
+    storage->used_ops = total_ops;
     if(total_ops == max_ops)
         doubleArrays();
 }
 
 // adds draw data for a mid point of the middle of a freehand line
 void DrawOperations::addDrawFreehandMid(int x, int y, unsigned int colour, int draw_size) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
     // set the current draw operation to a freehand line mid point and fill in the data
     LinePoint *temp = (LinePoint *) &operations[total_ops];
     temp->draw_operation = LINE_POINT;
@@ -57,12 +125,16 @@ void DrawOperations::addDrawFreehandMid(int x, int y, unsigned int colour, int d
 
     // update the total ops after we are done if we hit the max size then we need to up the array size
     total_ops++;
+    storage->used_ops = total_ops;
     if(total_ops == max_ops)
         doubleArrays();
 }
 
 // adds draw data for the end point of a freehand line
 void DrawOperations::addDrawFreehandEnd(int x, int y, unsigned int colour, int draw_size) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
     // set the current draw operation to a freehand line point and fill in the data
     LineEnd *temp = (LineEnd *) &operations[total_ops];
     temp->draw_operation = LINE_END;
@@ -73,12 +145,42 @@ void DrawOperations::addDrawFreehandEnd(int x, int y, unsigned int colour, int d
 
     // update the total ops after we are done if we hit the max size then we need to up the array size
     total_ops++;
+    storage->used_ops = total_ops;
     if(total_ops == max_ops)
         doubleArrays();
 }
 
+// adds the draw data for a whole freehand line from a contiguous list of points in one go. the first point is the
+// start of the line and the last point its end. a single point only starts a line
+void DrawOperations::addDrawFreehandLine(const QPoint *points, unsigned int count, unsigned int colour, int draw_size) {
+    // make room for the whole line up front so the arrays are only checked once
+    if(count == 0)
+        return;
+    reserveOps(count);
+
+    // fill in every point of the line as a line point and then mark the start and end
+    for(unsigned int i = 0; i < count; i++) {
+        PointOp *temp = (PointOp *) &operations[total_ops + i];
+        temp->draw_operation = LINE_POINT;
+        temp->x = points[i].x();
+        temp->y = points[i].y();
+        temp->colour = colour;
+        temp->size = draw_size;
+    }
+    operations[total_ops].draw_operation = LINE_START;
+    if(count > 1)
+        operations[total_ops + count - 1].draw_operation = LINE_END;
+
+    // update the total ops now that we are done
+    total_ops += count;
+    storage->used_ops = total_ops;
+}
+
 // adds draw data for a circle point
 void DrawOperations::addDrawPointCircle(int x, int y, unsigned int colour, int draw_size) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
     // set the current draw operation to a circle point and fill in the data
     PointCircle *temp = (PointCircle *) &operations[total_ops];
     temp->draw_operation = POINT_CIRCLE;
@@ -89,12 +191,16 @@ void DrawOperations::addDrawPointCircle(int x, int y, unsigned int colour, int d
 
     // update the total ops after we are done if we hit the max size then we need to up the array size
     total_ops++;
+    storage->used_ops = total_ops;
     if(total_ops == max_ops)
         doubleArrays();
 }
 
 // adds draw data for a square point
 void DrawOperations::addDrawPointSquare(int x, int y, unsigned int colour, int draw_size) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
     // set the current draw operation to a square point and fill in the data
     PointSquare *temp = (PointSquare *) &operations[total_ops];
     temp->draw_operation = POINT_SQUARE;
@@ -105,12 +211,46 @@ void DrawOperations::addDrawPointSquare(int x, int y, unsigned int colour, int d
 
     // update the total ops after we are done if we hit the max size then we need to up the array size
     total_ops++;
+    storage->used_ops = total_ops;
     if(total_ops == max_ops)
         doubleArrays();
 }
 
+// adds a run of point and line draw data in one go. every entry in the run must be one of the point or line
+// operations as these are the only ones that don't hold any heap data
+void DrawOperations::addDrawPointRun(const PointOp *run, unsigned int count) {
+    // make room for the whole run up front so the arrays are only checked once
+    if(count == 0)
+        return;
+    reserveOps(count);
+
+    // copy the run across and update the total ops
+    for(unsigned int i = 0; i < count; i++)
+        *((PointOp *) &operations[total_ops + i]) = run[i];
+    total_ops += count;
+    storage->used_ops = total_ops;
+}
+
+// adds a run of point and line draw data that is laid out exactly as it is on disk. the records are copied
+// across one at a time as they may not be aligned and are smaller than the draw operations they go into
+void DrawOperations::addDrawPointRecords(const uchar *records, unsigned int count) {
+    // make room for the whole run up front so the arrays are only checked once
+    if(count == 0)
+        return;
+    reserveOps(count);
+
+    // copy the records across and update the total ops
+    for(unsigned int i = 0; i < count; i++)
+        memcpy(&operations[total_ops + i], records + i * sizeof(PointOp), sizeof(PointOp));
+    total_ops += count;
+    storage->used_ops = total_ops;
+}
+
 // adds draw data for an x point
 void DrawOperations::addDrawPointX(int x, int y, unsigned int colour, int draw_size) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
     // set the current draw operation to a square point and fill in the data
     PointX *temp = (PointX *) &operations[total_ops];
     temp->draw_operation = POINT_X;
@@ -121,12 +261,16 @@ void DrawOperations::addDrawPointX(int x, int y, unsigned int colour, int draw_s
 
     // update the total ops after we are done if we hit the max size then we need to up the array size
     total_ops++;
+    storage->used_ops = total_ops;
     if(total_ops == max_ops)
         doubleArrays();
 }
 
 // adds draw data for a straight line end
 void DrawOperations::addDrawStraightLineEnd(int x, int y, unsigned int colour, int draw_size) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
     // set the current draw operation to a straight line start and fill in the data
     StraightLineEnd *temp = (StraightLineEnd *) &operations[total_ops];
     temp->draw_operation = STRAIGHT_LINE_END;
@@ -137,12 +281,16 @@ void DrawOperations::addDrawStraightLineEnd(int x, int y, unsigned int colour, i
 
     // update the total ops after we are done if we hit the max size then we need to up the array size
     total_ops++;
+    storage->used_ops = total_ops;
     if(total_ops == max_ops)
         doubleArrays();
 }
 
 // adds draw data for a straight line start
 void DrawOperations::addDrawStraightLineStart(int x, int y, unsigned int colour, int draw_size) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
     // set the current draw operation to a straight line start and fill in the data
     StraightLineStart *temp = (StraightLineStart *) &operations[total_ops];
     temp->draw_operation = STRAIGHT_LINE_START;
@@ -153,12 +301,16 @@ void DrawOperations::addDrawStraightLineStart(int x, int y, unsigned int colour,
 
     // update the total ops after we are done if we hit the max size then we need to up the array size
     total_ops++;
+    storage->used_ops = total_ops;
     if(total_ops == max_ops)
         doubleArrays();
 }
 
 // adds in drawn text to the draw operations as this needs to be handled differently to the other operations
 void DrawOperations::addDrawText(const QString &text, int x, int y, unsigned int colour, int draw_size, int draw_rotation) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
     // set the current draw operation to a text operation and fill in the data
     Text *temp = (Text *) &operations[total_ops];
     temp->draw_operation = DRAW_TEXT;
@@ -171,12 +323,24 @@ void DrawOperations::addDrawText(const QString &text, int x, int y, unsigned int
 
     // update the total ops after we are done if we hit the max size then we need to up the array size
     total_ops++;
+    storage->used_ops = total_ops;
     if(total_ops == max_ops)
         doubleArrays();
 }
 
 // adds in a drawn raster image to the draw operations as this needs to be handled differently to other operations
 void DrawOperations::addDrawRasterImage(const QString &file, int x, int y, int width, int height) {
+    // load the image in and hand it over, the operation takes its own reference to it
+    ImageAsset *asset = acquireRasterAsset(file);
+    addDrawRasterImage(asset, x, y, width, height);
+    releaseImageAsset(asset);
+}
+
+// adds in a raster image that is already loaded, taking another reference to it
+void DrawOperations::addDrawRasterImage(ImageAsset *asset, int x, int y, int width, int height) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
     // set the current draw operation to a raster image and fill in the data
     RasterImage *temp = (RasterImage *) &operations[total_ops];
     temp->draw_operation = DRAW_RASTER;
@@ -184,39 +348,89 @@ void DrawOperations::addDrawRasterImage(const QString &file, int x, int y, int w
     temp->y = y;
     temp->width = width;
     temp->height = height;
-    temp->filename = new QString(file);
-    temp->image = new QImage(file);
+    retainImageAsset(asset);
+    temp->asset = asset;
 
     // update the total ops after we are done if we hit the max size then we need to up the array size
     total_ops++;
+    storage->used_ops = total_ops;
     if(total_ops == max_ops)
         doubleArrays();
 }
 
 // adds in a drawn vector image to the draw operations as this needs to be handled differently to other operations
 void DrawOperations::addDrawSVGImage(const QString &file, int x, int y, int width, int height) {
+    // load the image in and hand it over, the operation takes its own reference to it
+    ImageAsset *asset = acquireSVGAsset(file);
+    addDrawSVGImage(asset, x, y, width, height);
+    releaseImageAsset(asset);
+}
+
+// adds in a vector image that is already loaded, taking another reference to it
+void DrawOperations::addDrawSVGImage(ImageAsset *asset, int x, int y, int width, int height) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
     // set the current draw operation to an SVG image and fill in the data
-    // set the current draw operation to a raster image and fill in the data
     SVGImage *temp = (SVGImage *) &operations[total_ops];
     temp->draw_operation = DRAW_SVG;
     temp->x = x;
     temp->y = y;
     temp->width = width;
     temp->height = height;
-    temp->filename = new QString(file);
-    temp->image = new QSvgRenderer(file);
+    retainImageAsset(asset);
+    temp->asset = asset;
 
     // update the total ops after we are done if we hit the max size then we need to up the array size
     total_ops++;
+    storage->used_ops = total_ops;
     if(total_ops == max_ops)
         doubleArrays();
 }
 
+// makes this draw operations a copy of the source that shares its operations until either one is changed
+void DrawOperations::duplicateFrom(DrawOperations *source) {
+    // take a reference on the source block before letting go of our own in case they are one and the same
+    OpStorage *old_storage = storage;
+    source->storage->ref_count.ref();
+    storage = source->storage;
+    releaseStorage(old_storage);
+
+    // pick up everything else from the source
+    operations = storage->operations;
+    max_ops = storage->max_ops;
+    total_ops = source->total_ops;
+    title = source->title;
+    locked = source->locked;
+    locked_op = source->locked_op;
+
+    // the locked operations are the same so the baked copies of them can be shared as well
+    locked_raster = source->locked_raster;
+    locked_picture = source->locked_picture;
+    locked_raster_valid = source->locked_raster_valid;
+    locked_picture_valid = source->locked_picture_valid;
+    keyframes = source->keyframes;
+    thumbnail = source->thumbnail;
+    thumbnail_ops = source->thumbnail_ops;
+    thumbnail_valid = source->thumbnail_valid;
+}
+
 // locks the current image to the current draw ops
 void DrawOperations::lockImage() {
     // set the lock status and lock it to the current set of ops
     locked = true;
     locked_op = total_ops;
+
+    // anything baked for an earlier lock no longer matches
+    invalidateLockedCache();
+}
+
+// function that will throw away the baked copies of the locked operations
+void DrawOperations::invalidateLockedCache() {
+    locked_raster = QImage();
+    locked_picture = QPicture();
+    locked_raster_valid = false;
+    locked_picture_valid = false;
 }
 
 // refactored function that will remove the last set of draw data from the arrays
@@ -229,6 +443,9 @@ void DrawOperations::removeLastDrawData() {
     if(locked && locked_op == total_ops)
         return;
 
+    // make sure removing the data won't affect anyone we share the operations with
+    prepareWrite(true);
+
     // reduce total_ops by one to line up on the data we are removing
     total_ops--;
 
@@ -245,8 +462,23 @@ void DrawOperations::removeLastDrawData() {
         removeStraightLine();
     else if(operations[total_ops].draw_operation == DRAW_TEXT)
         removeText();
+    else if(operations[total_ops].draw_operation == DRAW_RASTER)
+        removeRasterImage();
     else if(operations[total_ops].draw_operation == DRAW_SVG)
         removeSVGImage();
+
+    // the block now only holds the operations that are left and any keyframes past them are out of date, as is the
+    // thumbnail if it showed the operation just removed
+    storage->used_ops = total_ops;
+    if(total_ops < thumbnail_ops)
+        thumbnail_valid = false;
+    for(unsigned int i = 0; i < TOTAL_JOURNALS; i++) {
+        if(total_ops < journal_marks[i].low)
+            journal_marks[i].low = total_ops;
+    }
+    QMap<unsigned int, QImage>::iterator keyframe = keyframes.upperBound(total_ops);
+    while(keyframe != keyframes.end())
+        keyframe = keyframes.erase(keyframe);
 }
 
 // removes the current point circle data
@@ -317,16 +549,15 @@ void DrawOperations::removeFreehandLine() {
 void DrawOperations::removeRasterImage() {
     // get the raster data and clear it
     RasterImage *temp = (RasterImage *) &operations[total_ops];
+    temp->draw_operation = NO_DRAW;
     temp->x = 0;
     temp->y = 0;
     temp->width = 0;
     temp->height = 0;
 
-    // delete the file name and image and set them to null
-    delete temp->filename;
-    delete temp->image;
-    temp->filename = NULL;
-    temp->image = NULL;
+    // drop our reference to the image and set it to null
+    releaseImageAsset(temp->asset);
+    temp->asset = NULL;
 }
 
 // removes the current straight line data
@@ -353,16 +584,15 @@ void DrawOperations::removeStraightLine() {
 void DrawOperations::removeSVGImage() {
     // get the raster data and clear it
     SVGImage *temp = (SVGImage *) &operations[total_ops];
+    temp->draw_operation = NO_DRAW;
     temp->x = 0;
     temp->y = 0;
     temp->width = 0;
     temp->height = 0;
 
-    // delete the file name and image and set them to null
-    delete temp->filename;
-    delete temp->image;
-    temp->filename = NULL;
-    temp->image = NULL;
+    // drop our reference to the image and set it to null
+    releaseImageAsset(temp->asset);
+    temp->asset = NULL;
 }
 
 // removes the current text data
@@ -383,22 +613,112 @@ void DrawOperations::removeText() {
 
 // function that will double up the size of the arrays
 void DrawOperations::doubleArrays() {
-    // figure out how much space we need for the new set of draw operations and get that allocated
-    unsigned int new_max_ops = max_ops * 2;
-    DrawOp *new_ops = (DrawOp *) new DrawOp[new_max_ops];
-
-    // do a mem copy of the array delete the old array, fix the reference and update the max ops
-    memcpy(new_ops, operations, sizeof(DrawOp) * max_ops);
-    delete operations;
-    operations = new_ops;
+    // move the operations over into a block twice the size
+    copyStorage(max_ops * 2);
+}
+
+// function that will make sure this object can change its operations without affecting anyone it shares them with.
+// the owner of a block can keep adding to it in place as the others sharing it only look at the operations they
+// had when the block was shared. removing data or adding to a block we don't own means taking our own copy
+void DrawOperations::prepareWrite(bool removing) {
+    // if nobody else is using the block then we can take it over whether or not we were its owner
+    if(storage->ref_count.loadAcquire() == 1) {
+        // the previous owner may have written past the operations we can see so free what they left behind
+        if(storage->owner != this) {
+            releaseOps(operations, total_ops, storage->used_ops);
+            storage->used_ops = total_ops;
+            storage->owner = this;
+        }
+        return;
+    }
+
+    // the block is shared so take our own copy of it unless we are its owner and only adding
+    if(removing || storage->owner != this)
+        copyStorage(max_ops);
+}
+
+// function that will move the operations into a new block of the given size that is owned by this object
+void DrawOperations::copyStorage(unsigned int new_max_ops) {
+    // allocate the new block and do a mem copy of the operations we can see into it
+    OpStorage *new_storage = createStorage(new_max_ops, this);
+    memcpy(new_storage->operations, operations, sizeof(DrawOp) * total_ops);
+    new_storage->used_ops = total_ops;
+
+    if(storage->ref_count.loadAcquire() == 1) {
+        // nobody else is using the old block so its heap data simply moves across. free anything past the
+        // operations we can see and then delete the old array
+        releaseOps(operations, total_ops, storage->used_ops);
+        delete [] storage->operations;
+        delete storage;
+    } else {
+        // the old block is still in use so take our own references to the heap data and let go of it
+        retainOps(new_storage->operations, 0, total_ops);
+        if(storage->owner == this)
+            storage->owner = NULL;
+        releaseStorage(storage);
+    }
+
+    // fix the references and update the max ops
+    storage = new_storage;
+    operations = storage->operations;
     max_ops = new_max_ops;
 }
 
+// function that will make room for the given number of further operations so the arrays don't grow while adding
+// them. like the single adds this always leaves one free op at the end of the arrays
+void DrawOperations::reserveOps(unsigned int count) {
+    // make sure we are free to add to the operations
+    prepareWrite(false);
+
+    // keep doubling the size until everything fits and move the operations over if it has changed
+    unsigned int new_max_ops = max_ops;
+    while(total_ops + count >= new_max_ops)
+        new_max_ops <<= 1;
+    if(new_max_ops != max_ops)
+        copyStorage(new_max_ops);
+}
+
 // function that will reset the entire drawoperations back to the starting state
 void DrawOperations::reset() {
+    // drop any lock so that every operation can be removed
+    unlockImage();
+
+    // if the operations are shared then just let go of them and start again on an empty block
+    if(storage->ref_count.loadAcquire() > 1) {
+        releaseStorage(storage);
+        storage = createStorage(max_ops, this);
+        operations = storage->operations;
+        total_ops = 0;
+        keyframes.clear();
+        thumbnail_valid = false;
+    }
+
     // while our total ops are greater whan zero keep removing draw ops
     while(total_ops > 0)
         removeLastDrawData();
+
+    // the image is going back to being unused so none of it is in the saved file anymore
+    clearJournalMarks();
+}
+
+// function that will forget everything the saved files hold for this image
+void DrawOperations::clearJournalMarks() {
+    for(unsigned int i = 0; i < TOTAL_JOURNALS; i++) {
+        journal_marks[i].ops = 0;
+        journal_marks[i].low = 0;
+        journal_marks[i].title = QString("");
+        journal_marks[i].locked = false;
+        journal_marks[i].locked_op = 0;
+    }
+}
+
+// function that will record that everything in this image is now held in the file of the given journal
+void DrawOperations::markJournalled(unsigned int journal) {
+    journal_marks[journal].ops = total_ops;
+    journal_marks[journal].low = total_ops;
+    journal_marks[journal].title = title;
+    journal_marks[journal].locked = locked;
+    journal_marks[journal].locked_op = locked_op;
 }
 
 // function that will set the title of this image
@@ -406,8 +726,15 @@ void DrawOperations::setTitle(const QString& new_title) {
     title = new_title;
 }
 
+// function that will tell us if the thumbnail shows the image as it is now. any operation removed since it was
+// made has already marked it as invalid, so it only has to be checked against what has been added
+const bool DrawOperations::thumbnailCurrent() {
+    return thumbnail_valid && thumbnail_ops == total_ops;
+}
+
 // locks the current image to the current draw ops
 void DrawOperations::unlockImage() {
     locked = false;
     locked_op = 0;
+    invalidateLockedCache();
 }
@@ -12,8 +12,15 @@
 // a lot of time to drop getter function calls on a redraw.
 
 // includes
+#include <QAtomicInt>
 #include <QColor>
+#include <QImage>
+#include <QMap>
+#include <QPicture>
+#include <QPoint>
 #include <QtSvg>
+#include "constants.hpp"
+#include "imageasset.hpp"
 
 // structure definitions for all of the operation types
 
@@ -89,6 +96,10 @@ struct StraightLineEnd {
     int size; // the size of the point
 };
 
+// all of the point and line structures above share the same layout. this is used to refer to any one of them
+// when they are being handled in bulk
+typedef PointCircle PointOp;
+
 // structure marking where a text has been written in the image
 struct Text {
     unsigned int draw_operation; // common starting value to determine what the rest of the values in the struct are
@@ -107,8 +118,7 @@ struct RasterImage {
     int y; // y position of the circle
     int width; // the width of the image
     int height; // the height of the image
-    QString *filename; // the name of the file that the image is loaded from
-    QImage *image; // the loaded in image.
+    ImageAsset *asset; // the shared image along with the name of the file it was loaded from
 };
 
 // structure marking where an SVG image has been placed in this whiteboard
@@ -118,8 +128,7 @@ struct SVGImage {
     int y; // y position of the circle
     int width; // the width of the image
     int height; // the height of the image
-    QString *filename; // the name of the file that the image is loaded from
-    QSvgRenderer *image; // the loaded in image.
+    ImageAsset *asset; // the shared image along with the name of the file it was loaded from
 };
 
 // union type that will collect all the operations into one overlapping structure. note that we declare the draw
@@ -139,6 +148,38 @@ union DrawOp {
     SVGImage svg_image;
 };
 
+// forward declaration of the class so the storage can refer to its owner
+class DrawOperations;
+
+// structure holding the block of memory that draw operations are kept in. a block can be shared between several
+// draw operations objects, such as a board and its duplicate, so that copies cost nothing until one of them is
+// changed. only the owner of a block may add to it in place, anyone else sharing it will make their own copy of
+// it before changing anything
+struct OpStorage {
+    DrawOp *operations; // the draw operations held in this block
+    unsigned int max_ops; // how many operations the block can hold
+    unsigned int used_ops; // how many operations have been written into the block by its owner
+    QAtomicInt ref_count; // how many draw operations objects are using this block
+    DrawOperations *owner; // the draw operations object allowed to add to this block in place
+};
+
+// structure describing a change to the list of images of a whiteboard that has not been saved yet. these are
+// written to the journal of the saved file so a save doesn't have to rewrite every image
+struct JournalEvent {
+    unsigned int type; // the type of change, either JOURNAL_INSERT or JOURNAL_DELETE
+    unsigned int index; // the index of the image that was inserted or deleted
+};
+
+// structure describing how much of an image a saved file holds. ops is how many operations the file has for the
+// image and low is the fewest operations the image has had since, anything past that has been undone
+struct JournalMark {
+    unsigned int ops; // how many operations the file has for the image
+    unsigned int low; // the fewest operations the image has had since it was saved
+    QString title; // the title the file has for the image
+    bool locked; // the lock the file has for the image
+    unsigned int locked_op; // the op the file has the image locked at
+};
+
 // class definition
 class DrawOperations {
 // public section of the class
@@ -148,6 +189,9 @@ public:
     // constructor that will make a draw operations object with the given number of objects and
     // a maximum number of strings
     DrawOperations(const unsigned int max_ops);
+    // constructor that will make a snapshot of the source that shares its operations. nothing is allocated for the
+    // snapshot so it is cheap enough to take of every image at once
+    DrawOperations(DrawOperations *source);
     // destructor for the class
     ~DrawOperations();
     // adds draw data for the start point of a freehand line
@@ -156,10 +200,16 @@ public:
     void addDrawFreehandMid(int x, int y, unsigned int colour, int draw_size);
     // adds draw data for the end point of a freehand line
     void addDrawFreehandEnd(int x, int y, unsigned int colour, int draw_size);
+    // adds the draw data for a whole freehand line from a contiguous list of points in one go
+    void addDrawFreehandLine(const QPoint *points, unsigned int count, unsigned int colour, int draw_size);
     // adds draw data for a circle point
     void addDrawPointCircle(int x, int y, unsigned int colour, int draw_size);
     // adds draw data for a square point
     void addDrawPointSquare(int x, int y, unsigned int colour, int draw_size);
+    // adds a run of point and line draw data in one go
+    void addDrawPointRun(const PointOp *run, unsigned int count);
+    // adds a run of point and line draw data that is laid out exactly as it is on disk
+    void addDrawPointRecords(const uchar *records, unsigned int count);
     // adds draw data for an x point
     void addDrawPointX(int x, int y, unsigned int colour, int draw_size);
     // adds draw data for a straight line end
@@ -170,8 +220,14 @@ public:
     void addDrawText(const QString &text, int x, int y, unsigned int colour, int draw_size, int draw_rotation);
     // adds in a drawn raster image to the draw operations as this needs to be handled differently to other operations
     void addDrawRasterImage(const QString &file, int x, int y, int width, int height);
+    // adds in a raster image that is already loaded, taking another reference to it
+    void addDrawRasterImage(ImageAsset *asset, int x, int y, int width, int height);
     // adds in a drawn vector image to the draw operations as this needs to be handled differently to other operations
     void addDrawSVGImage(const QString &file, int x, int y, int width, int height);
+    // adds in a vector image that is already loaded, taking another reference to it
+    void addDrawSVGImage(ImageAsset *asset, int x, int y, int width, int height);
+    // makes this draw operations a copy of the source that shares its operations until either one is changed
+    void duplicateFrom(DrawOperations *source);
     // locks the current image to the current draw ops
     void lockImage();
     // removes the last set of draw data from this draw operations
@@ -192,12 +248,26 @@ public:
     void removeSVGImage();
     // removes the current text data
     void removeText();
+    // function that will throw away the baked copies of the locked operations
+    void invalidateLockedCache();
+    // function that will forget everything the saved files hold for this image
+    void clearJournalMarks();
+    // function that will record that everything in this image is now held in the file of the given journal
+    void markJournalled(unsigned int journal);
     // private function that will increase the size of the draw ops arrays by doubling them
     void doubleArrays();
+    // function that will make sure this object can change its operations without affecting anyone it shares them with
+    void prepareWrite(bool removing);
+    // function that will move the operations into a new block of the given size that is owned by this object
+    void copyStorage(unsigned int new_max_ops);
+    // function that will make room for the given number of further operations so the arrays don't grow while adding them
+    void reserveOps(unsigned int count);
     // function that will reset the entire drawoperations back to the starting state
     void reset();
     // function that will set the title of this image
     void setTitle(const QString& new_title);
+    // function that will tell us if the thumbnail shows the image as it is now
+    const bool thumbnailCurrent();
     // function that will unlock the image
     void unlockImage();
     // how many operations in total in this draw operations
@@ -206,11 +276,31 @@ public:
     unsigned int max_ops;
     // the title of the current image
     QString title;
-    // list of draw operations that is held by this object
+    // list of draw operations that is held by this object. this points into the storage below
     DrawOp *operations;
+    // the possibly shared block of memory that holds the draw operations
+    OpStorage *storage;
     // tells us if a lock has been set on this image and if so where
     bool locked;
     unsigned int locked_op;
+    // baked copies of the locked operations [0, locked_op) so they don't have to be replayed on every draw. the
+    // raster is used when drawing the board at its own size and the picture when drawing it through a transform.
+    // both are only made when they are first needed
+    QImage locked_raster;
+    QPicture locked_picture;
+    bool locked_raster_valid;
+    bool locked_picture_valid;
+    // raster keyframes of the board looked up by the op they were baked at. a keyframe holds the result of drawing
+    // ops [0, key) so drawing up to any point in the history only needs a short replay from the nearest one
+    QMap<unsigned int, QImage> keyframes;
+    // small compressed preview of the board as it was after thumbnail_ops operations, which is written to the saved
+    // file so it can be shown without loading the board. it is only up to date while it is valid and no operations
+    // have been added since
+    QByteArray thumbnail;
+    unsigned int thumbnail_ops;
+    bool thumbnail_valid;
+    // how much of this image the file of each journal holds
+    JournalMark journal_marks[TOTAL_JOURNALS];
 };
 
 #endif // _DRAWOPERATIONS_HPP
@@ -4,9 +4,20 @@
 
 // includes
 #include <cstdio>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <QBuffer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
 #include <QStringList>
 #include <QRegularExpression>
+#include <QThreadPool>
+#include "backgroundtasks.hpp"
+#include "checksum.hpp"
 #include "constants.hpp"
 #include "fileops.hpp"
 
@@ -73,247 +84,824 @@ QString determineRelativePath(QString whiteboard_path, QString image_path) {
     }
 }
 
-// function that will load a line end from disk
-void loadLineEnd(DrawOperations *image, unsigned int draw_operation, FILE *to_read) {
-    // read in all four values for the line end and add it into the image
-    unsigned int colour = 0;
-    int x = 0, y = 0, size = 0;
-    fread(&x, sizeof(int), 1, to_read);
-    fread(&y, sizeof(int), 1, to_read);
-    fread(&colour, sizeof(unsigned int), 1, to_read);
-    fread(&size, sizeof(int), 1, to_read);
-    image->addDrawFreehandEnd(x, y, colour, size);
-}
-
-// function that will load a line point from disk
-void loadLinePoint(DrawOperations *image, unsigned int draw_operation, FILE *to_read) {
-    // read in all four values for the line end and add it into the image
-    unsigned int colour = 0;
-    int x = 0, y = 0, size = 0;
-    fread(&x, sizeof(int), 1, to_read);
-    fread(&y, sizeof(int), 1, to_read);
-    fread(&colour, sizeof(unsigned int), 1, to_read);
-    fread(&size, sizeof(int), 1, to_read);
-    image->addDrawFreehandMid(x, y, colour, size);
-}
-
-// function that will load a line end from disk
-void loadLineStart(DrawOperations *image, unsigned int draw_operation, FILE *to_read) {
-    // read in all four values for the line start and add it into the image
-    unsigned int colour = 0;
-    int x = 0, y = 0, size = 0;
-    fread(&x, sizeof(int), 1, to_read);
-    fread(&y, sizeof(int), 1, to_read);
-    fread(&colour, sizeof(unsigned int), 1, to_read);
-    fread(&size, sizeof(int), 1, to_read);
-    image->addDrawFreehandStart(x, y, colour, size);
-}
-
-// function that will load a point circle from disk
-void loadPointCircle(DrawOperations *image, unsigned int draw_operation, FILE *to_read) {
-    // read in all four values for the point circle and add it into the image
-    unsigned int colour = 0;
-    int x = 0, y = 0, size = 0;
-    fread(&x, sizeof(int), 1, to_read);
-    fread(&y, sizeof(int), 1, to_read);
-    fread(&colour, sizeof(unsigned int), 1, to_read);
-    fread(&size, sizeof(int), 1, to_read);
-    image->addDrawPointCircle(x, y, colour, size);
-}
-
-// function that will load a point square from disk
-void loadPointSquare(DrawOperations *image, unsigned int draw_operation, FILE *to_read) {
-    // read in all four values for the point square and add it into the image
-    unsigned int colour = 0;
-    int x = 0, y = 0, size = 0;
-    fread(&x, sizeof(int), 1, to_read);
-    fread(&y, sizeof(int), 1, to_read);
-    fread(&colour, sizeof(unsigned int), 1, to_read);
-    fread(&size, sizeof(int), 1, to_read);
-    image->addDrawPointSquare(x, y, colour, size);
-}
-
-// function that will load an x point from disk
-void loadPointX(DrawOperations *image, unsigned int draw_operation, FILE *to_read) {
-    // read in all four values for the point x and add it into the image
-    unsigned int colour = 0;
-    int x = 0, y = 0, size = 0;
-    fread(&x, sizeof(int), 1, to_read);
-    fread(&y, sizeof(int), 1, to_read);
-    fread(&colour, sizeof(unsigned int), 1, to_read);
-    fread(&size, sizeof(int), 1, to_read);
-    image->addDrawPointX(x, y, colour, size);
-}
-
-// function that will load a QString from disk and will return it
-QString loadQString(FILE *to_read) {
-    // read in the length of the string from disk
-    unsigned int length = 0;
-    fread(&length, sizeof(unsigned int), 1, to_read);
-
-    // allocate the necessary space for the character data and read it in
-    char *data = new char[length];
-    fread(data, sizeof(char), length, to_read);
-
-    // get and return the qstring. make sure to deallocate the array before returning
-    QString temp = QString::fromUtf8(data, length);
-    //delete data;
-    return temp;
-}
-
-// function that will load a raster image from disk
-void loadRasterImage(DrawOperations *image, unsigned int draw_operation, FILE *to_read, QString &filename) {
+// function that will tell us if the given draw operation is one of the point or line operations
+bool isPointOp(unsigned int draw_operation) {
+    return draw_operation == POINT_CIRCLE || draw_operation == POINT_SQUARE || draw_operation == POINT_X ||
+        draw_operation == LINE_START || draw_operation == LINE_POINT || draw_operation == LINE_END ||
+        draw_operation == STRAIGHT_LINE_START || draw_operation == STRAIGHT_LINE_END;
+}
+
+// function that will read raw bytes out of the whiteboard data. if there are not enough bytes left the reader is
+// marked as failed, the destination is zeroed and false is returned
+bool readBytes(WhiteboardReader *reader, void *destination, qint64 length) {
+    // once a read has failed every read after it fails as well
+    if(reader->failed || length < 0 || length > reader->size - reader->position) {
+        reader->failed = true;
+        memset(destination, 0, length > 0 ? length : 0);
+        return false;
+    }
+
+    // copy the bytes across and move on past them
+    memcpy(destination, reader->data + reader->position, length);
+    reader->position += length;
+    return true;
+}
+
+// function that will return a pointer to the next length bytes of the whiteboard data and move past them. this
+// returns null and marks the reader as failed if there are not enough bytes left
+const uchar *readSpan(WhiteboardReader *reader, qint64 length) {
+    // once a read has failed every read after it fails as well
+    if(reader->failed || length < 0 || length > reader->size - reader->position) {
+        reader->failed = true;
+        return NULL;
+    }
+
+    // hand back the bytes where they are and move on past them
+    const uchar *span = reader->data + reader->position;
+    reader->position += length;
+    return span;
+}
+
+// function that will read an unsigned int out of the whiteboard data. this returns zero if the read fails
+unsigned int readUInt(WhiteboardReader *reader) {
+    unsigned int value = 0;
+    readBytes(reader, &value, sizeof(unsigned int));
+    return value;
+}
+
+// function that will read a varint out of the whiteboard data. each byte holds seven bits of the value with the
+// top bit set on every byte but the last. this returns zero if the read fails
+unsigned int readVarint(WhiteboardReader *reader) {
+    unsigned int value = 0;
+    for(unsigned int shift = 0; shift < 35; shift += 7) {
+        // make sure the next byte is there
+        if(reader->failed || reader->position >= reader->size) {
+            reader->failed = true;
+            return 0;
+        }
+
+        // add its seven bits in and stop if it is the last byte
+        uchar byte = reader->data[reader->position++];
+        value |= (unsigned int) (byte & 0x7F) << shift;
+        if((byte & 0x80) == 0)
+            return value;
+    }
+
+    // no value we write takes up more than five bytes
+    reader->failed = true;
+    return 0;
+}
+
+// function that will load a freehand line stored as a start point followed by the differences between each point.
+// the points are decoded into the given scratch space and added to the image in one go. at most max_points points
+// are accepted and the number of points in the line is returned
+unsigned int loadStroke(DrawOperations *image, WhiteboardReader *reader, QVector<QPoint> &points, unsigned int max_points) {
+    // read in the colour, size and number of points. every point takes up at least two bytes
+    unsigned int colour = readUInt(reader);
+    int draw_size = (int) readUInt(reader);
+    unsigned int count = readVarint(reader);
+    if(reader->failed || count == 0 || count > max_points || count > (reader->size - reader->position) / 2) {
+        reader->failed = true;
+        return 0;
+    }
+
+    // undo the zig-zag coding of each difference and add it onto the previous point. the first point is the
+    // difference from zero
+    points.resize(count);
+    unsigned int x = 0, y = 0;
+    for(unsigned int i = 0; i < count; i++) {
+        unsigned int dx = readVarint(reader);
+        unsigned int dy = readVarint(reader);
+        x += (dx >> 1) ^ (0 - (dx & 1));
+        y += (dy >> 1) ^ (0 - (dy & 1));
+        points[i] = QPoint((int) x, (int) y);
+    }
+    if(reader->failed)
+        return 0;
+
+    // add in the whole line
+    image->addDrawFreehandLine(points.constData(), count, colour, draw_size);
+    return count;
+}
+
+// function that will count how many point and line operations follow on from the current position, up to the
+// given limit. the operations are not moved past
+unsigned int countPointRun(WhiteboardReader *reader, unsigned int limit) {
+    // the number of whole records that are left in the data
+    qint64 records_left = (reader->size - reader->position) / (qint64) sizeof(PointOp);
+    if(records_left < limit)
+        limit = (unsigned int) records_left;
+
+    // keep going until we find an operation that isn't a point or a line
+    unsigned int count = 0;
+    const uchar *record = reader->data + reader->position;
+    while(count < limit) {
+        unsigned int draw_operation = 0;
+        memcpy(&draw_operation, record + count * sizeof(PointOp), sizeof(unsigned int));
+        if(!isPointOp(draw_operation))
+            break;
+        count++;
+    }
+    return count;
+}
+
+// function that will load a QString from the whiteboard data and will return it. the characters are decoded
+// straight out of the data so nothing needs to be allocated for them
+QString loadQString(WhiteboardReader *reader) {
+    // read in the length of the string and find where its characters are
+    unsigned int length = readUInt(reader);
+    const uchar *data = readSpan(reader, length);
+    if(data == NULL)
+        return QString();
+
+    // decode the characters into the string
+    return QString::fromUtf8((const char *) data, length);
+}
+
+// function that will look up the embedded image with the id that is next in the whiteboard data. this returns
+// null and marks the reader as failed if there is no such image or it isn't of the given type
+ImageAsset *loadAssetId(WhiteboardReader *reader, QVector<ImageAsset *> &assets, bool vector) {
+    unsigned int id = readUInt(reader);
+    if(reader->failed || id >= (unsigned int) assets.size() || assets.at(id)->vector != vector) {
+        reader->failed = true;
+        return NULL;
+    }
+    return assets.at(id);
+}
+
+// function that will load a raster image from the whiteboard data. the image is either the id of one of the
+// given embedded images or, if there are none, the path to it
+void loadRasterImage(DrawOperations *image, unsigned int draw_operation, WhiteboardReader *reader, QString &filename, QVector<ImageAsset *> *assets) {
     // read in the four integers
-    int x = 0, y = 0, width = 0, height = 0;
-    fread(&x, sizeof(int), 1, to_read);
-    fread(&y, sizeof(int), 1, to_read);
-    fread(&width, sizeof(int), 1, to_read);
-    fread(&height, sizeof(int), 1, to_read);
-
-    // read in the filename and add in the draw image
-    QString temp = loadQString(to_read);
+    int values[4] = {0, 0, 0, 0};
+    readBytes(reader, values, sizeof(values));
+
+    // embedded images are already loaded so they are just looked up
+    if(assets != NULL) {
+        ImageAsset *asset = loadAssetId(reader, *assets, false);
+        if(asset != NULL)
+            image->addDrawRasterImage(asset, values[0], values[1], values[2], values[3]);
+        return;
+    }
+
+    // read in the filename and add in the draw image if the data was all there
+    QString temp = loadQString(reader);
+    if(reader->failed)
+        return;
     QString full_path = recreateAbsolutePath(filename, temp);
-    image->addDrawRasterImage(full_path, x, y, width, height);
-}
-
-// function that will load a point square from disk
-void loadStraightLineStart(DrawOperations *image, unsigned int draw_operation, FILE *to_read) {
-    // read in all four values for the straight line start and add it into the image
-    unsigned int colour = 0;
-    int x = 0, y = 0, size = 0;
-    fread(&x, sizeof(int), 1, to_read);
-    fread(&y, sizeof(int), 1, to_read);
-    fread(&colour, sizeof(unsigned int), 1, to_read);
-    fread(&size, sizeof(int), 1, to_read);
-    image->addDrawStraightLineStart(x, y, colour, size);
-}
-
-// function that will load a straight line end from disk
-void loadStraightLineEnd(DrawOperations *image, unsigned int draw_operation, FILE *to_read) {
-    // read in all four values for the straight line end and add it into the image
-    unsigned int colour = 0;
-    int x = 0, y = 0, size = 0;
-    fread(&x, sizeof(int), 1, to_read);
-    fread(&y, sizeof(int), 1, to_read);
-    fread(&colour, sizeof(unsigned int), 1, to_read);
-    fread(&size, sizeof(int), 1, to_read);
-    image->addDrawStraightLineEnd(x, y, colour, size);
-}
-
-// function that will load an SVG image from disk
-void loadSVGImage(DrawOperations *image, unsigned int draw_operation, FILE *to_read, QString &filename) {
+    image->addDrawRasterImage(full_path, values[0], values[1], values[2], values[3]);
+}
+
+// function that will load an SVG image from the whiteboard data. the image is either the id of one of the given
+// embedded images or, if there are none, the path to it
+void loadSVGImage(DrawOperations *image, unsigned int draw_operation, WhiteboardReader *reader, QString &filename, QVector<ImageAsset *> *assets) {
     // read in the four integers
-    int x = 0, y = 0, width = 0, height = 0;
-    fread(&x, sizeof(int), 1, to_read);
-    fread(&y, sizeof(int), 1, to_read);
-    fread(&width, sizeof(int), 1, to_read);
-    fread(&height, sizeof(int), 1, to_read);
-
-    // read in the filename and add in the draw image
-    QString temp = loadQString(to_read);
+    int values[4] = {0, 0, 0, 0};
+    readBytes(reader, values, sizeof(values));
+
+    // embedded images are already loaded so they are just looked up
+    if(assets != NULL) {
+        ImageAsset *asset = loadAssetId(reader, *assets, true);
+        if(asset != NULL)
+            image->addDrawSVGImage(asset, values[0], values[1], values[2], values[3]);
+        return;
+    }
+
+    // read in the filename and add in the draw image if the data was all there
+    QString temp = loadQString(reader);
+    if(reader->failed)
+        return;
     QString full_path = recreateAbsolutePath(filename, temp);
-    image->addDrawSVGImage(full_path, x, y, width, height);
+    image->addDrawSVGImage(full_path, values[0], values[1], values[2], values[3]);
 }
 
-// function that will load a text op from disk
-void loadText(DrawOperations *image, unsigned int draw_operation, FILE *to_read) {
-    // read in the five integer values from disk
-    unsigned int colour = 0;
-    int x = 0, y = 0, size = 0, rotation = 0;
-    fread(&x, sizeof(int), 1, to_read);
-    fread(&y, sizeof(int), 1, to_read);
-    fread(&colour, sizeof(unsigned int), 1, to_read);
-    fread(&size, sizeof(int), 1, to_read);
-    fread(&rotation, sizeof(int), 1, to_read);
+// function that will load a text op from the whiteboard data
+void loadText(DrawOperations *image, unsigned int draw_operation, WhiteboardReader *reader) {
+    // read in the five integer values. these are x, y, colour, size and rotation
+    int values[5] = {0, 0, 0, 0, 0};
+    readBytes(reader, values, sizeof(values));
+
+    // read in the text and add in the text draw operation if the data was all there
+    QString temp = loadQString(reader);
+    if(reader->failed)
+        return;
+    image->addDrawText(temp, values[0], values[1], (unsigned int) values[2], values[3], values[4]);
+}
 
-    // read in the text and add in the text draw operation
-    QString temp = loadQString(to_read);
-    image->addDrawText(temp, x, y, colour, size, rotation);
+// function that will parse the given number of ops out of the data and add them onto the end of the board. the
+// flags say how the ops were stored and the images embedded in the file are looked up in assets. this returns
+// false if the data is malformed
+bool parseOps(WhiteboardReader *reader, DrawOperations *board, unsigned int total_ops, QString &filename, QVector<ImageAsset *> &assets, unsigned int flags) {
+    // go through each of the ops in turn and read them in
+    QVector<ImageAsset *> *embedded = (flags & BOARD_EMBEDDED_ASSETS) ? &assets : NULL;
+    QVector<QPoint> points;
+    unsigned int j = 0;
+    while(j < total_ops && !reader->failed) {
+        // point and line operations are stored just as they are in memory, so a whole run of them is copied
+        // straight out of the data in one go
+        unsigned int count = countPointRun(reader, total_ops - j);
+        if(count > 0) {
+            board->addDrawPointRecords(readSpan(reader, count * sizeof(PointOp)), count);
+            j += count;
+            continue;
+        }
 
+        // see what draw op we have and read in as appropriate. anything else means the file is damaged
+        unsigned int draw_operation = readUInt(reader);
+        if(draw_operation == FILE_STROKE && (flags & BOARD_DELTA_STROKES)) {
+            // a stroke adds every point of its line at once
+            j += loadStroke(board, reader, points, total_ops - j);
+            continue;
+        } else if(draw_operation == DRAW_TEXT)
+            loadText(board, draw_operation, reader);
+        else if(draw_operation == DRAW_RASTER)
+            loadRasterImage(board, draw_operation, reader, filename, embedded);
+        else if(draw_operation == DRAW_SVG)
+            loadSVGImage(board, draw_operation, reader, filename, embedded);
+        else
+            reader->failed = true;
+        j++;
+    }
+    return !reader->failed;
 }
 
-// function that will load a whiteboard from disk
-DrawOperations **loadWhiteboard(QString &filename, unsigned int *image_total, unsigned int *image_max) {
-    // the draw operations that we will return to the caller
-    DrawOperations **ops = NULL;
+// function that will parse a single board out of the given data. this is the total ops, the locked op and the
+// locked state followed by the ops themselves. the flags say how the board was stored and the images embedded in
+// the file are looked up in assets. this returns null if the data is malformed
+DrawOperations *parseBoard(WhiteboardReader *reader, QString &filename, QVector<ImageAsset *> &assets, unsigned int flags) {
+    // read in the total number of ops for this image. every op takes up at least the size of a point op, or two
+    // bytes for a point of a stroke, so check this against what is left before allocating anything
+    unsigned int total_ops = readUInt(reader);
+    qint64 min_op_size = (flags & BOARD_DELTA_STROKES) ? 2 : sizeof(PointOp);
+    if(reader->failed || total_ops > (reader->size - reader->position) / min_op_size) {
+        reader->failed = true;
+        return NULL;
+    }
+    DrawOperations *board = (DrawOperations *) new DrawOperations(determineMaxOps(total_ops));
+
+    // read in the locked op and the locked state for this image
+    board->locked_op = readUInt(reader);
+    unsigned char locked = 0;
+    readBytes(reader, &locked, sizeof(unsigned char));
+    board->locked = locked != 0;
+
+    // read in the ops and make sure the locked op doesn't point past them
+    parseOps(reader, board, total_ops, filename, assets, flags);
+    if(board->locked_op > board->total_ops)
+        reader->failed = true;
+
+    // throw away the board if anything was missing or out of place
+    if(reader->failed) {
+        delete board;
+        return NULL;
+    }
+    return board;
+}
 
-    // open the file for reading
-    FILE *to_read = fopen(filename.toStdString().c_str(), "rb");
+// function that will allocate the array of images for a whiteboard with the given number of images. every image
+// starts off as null
+DrawOperations **allocateWhiteboard(unsigned int total_images, unsigned int *image_max) {
+    *image_max = determineMaxImages(total_images);
+    DrawOperations **ops = (DrawOperations **) new DrawOperations *[*image_max];
+    for(unsigned int i = 0; i < *image_max; i++)
+        ops[i] = NULL;
+    return ops;
+}
 
-    // read in the total number of images for this file
-    unsigned int total_images = 0;
-    fread(&total_images, sizeof(unsigned int), 1, to_read);
+// function that will return the name of the file the given board is exported to, with the given extension. the
+// number of the board is padded out to three digits to ensure the filenames all appear in the correct order
+QString exportFilename(unsigned int index, const QString &extension) {
+    return QString("/%1.%2").arg(index + 1, 3, 10, QChar('0')).arg(extension);
+}
 
-    // figure out what our max images is and then allocate our draw images
-    unsigned int max_images = determineMaxImages(total_images);
-    ops = (DrawOperations **) new DrawOperations *[max_images];
+// function that will delete a whiteboard along with all of its images
+void freeWhiteboard(DrawOperations **ops, unsigned int max_images) {
+    for(unsigned int i = 0; i < max_images; i++)
+        delete ops[i];
+    delete [] ops;
+}
 
-    // go through each of the images in turn and read it in
+// function that will parse a whiteboard in the original format out of the given data. the boards are stored back
+// to back with all of the titles after them. this returns null if the data is malformed
+DrawOperations **parseWhiteboardV1(WhiteboardReader *reader, QString &filename, unsigned int *image_total, unsigned int *image_max) {
+    // read in the total number of images. every image takes up at least thirteen bytes so anything more than that
+    // can't be right and would have us allocating far more than the file could ever hold
+    unsigned int total_images = readUInt(reader);
+    if(reader->failed || total_images == 0 || total_images > reader->size / 13)
+        return NULL;
+
+    // allocate our draw images and then go through each of the images in turn and read it in
+    unsigned int max_images = 0;
+    QVector<ImageAsset *> assets;
+    DrawOperations **ops = allocateWhiteboard(total_images, &max_images);
+    for(unsigned int i = 0; i < total_images && !reader->failed; i++)
+        ops[i] = parseBoard(reader, filename, assets, 0);
+
+    // read in the titles for each of the images
+    for(unsigned int i = 0; i < total_images && !reader->failed; i++)
+        ops[i]->title = loadQString(reader);
+
+    // if anything was missing or out of place then throw away what we have read in
+    if(reader->failed) {
+        freeWhiteboard(ops, max_images);
+        return NULL;
+    }
+
+    // any images that have not been loaded fill them with empty images
+    for(unsigned int i = total_images; i < max_images; i++)
+        ops[i] = (DrawOperations *) new DrawOperations();
+
+    // return the images, max images, and total images
+    *image_max = max_images;
+    *image_total = total_images;
+    return ops;
+}
+
+// function that will read in the section of previews that follows the header of a versioned whiteboard. the
+// section is read through a reader that only covers it so a damaged preview can't run on into the directory. the
+// cover is only copied out if it is asked for. this returns false if the section is malformed
+bool loadPreviewSection(WhiteboardReader *reader, unsigned int total_images, QByteArray *cover, QVector<QByteArray> &thumbnails) {
+    // find the section and skip the reader past it
+    unsigned int section_size = readUInt(reader);
+    const uchar *section = readSpan(reader, section_size);
+    if(reader->failed)
+        return false;
+    WhiteboardReader section_reader;
+    section_reader.data = section;
+    section_reader.size = section_size;
+    section_reader.position = 0;
+    section_reader.failed = false;
+
+    // read in the cover followed by the thumbnail of each board. every thumbnail takes up at least its size so
+    // check the number of images against what is left first
+    unsigned int cover_size = readUInt(&section_reader);
+    const uchar *cover_data = readSpan(&section_reader, cover_size);
+    if(section_reader.failed || total_images > (section_reader.size - section_reader.position) / sizeof(unsigned int))
+        return false;
+    if(cover != NULL)
+        *cover = QByteArray((const char *) cover_data, (int) cover_size);
+    thumbnails.resize(total_images);
     for(unsigned int i = 0; i < total_images; i++) {
-        // read in the total number of ops for this image and then the required max ops, then allocate the necessary image
-        unsigned int total_ops = 0;
-        fread(&total_ops, sizeof(unsigned int), 1, to_read);
-        unsigned int max_ops = determineMaxOps(total_ops);
-        ops[i] = (DrawOperations *) new DrawOperations(max_ops);
-
-        // read in the locked op and the locked state for this image
-        unsigned int locked_ops = 0;
-        bool locked = false;
-        fread(&locked_ops, sizeof(unsigned int), 1, to_read);
-        fread(&locked, sizeof(bool), 1, to_read);
-        ops[i]->locked = locked;
-        ops[i]->locked_op = locked_ops;
-
-        // go through each of the ops in turn and read them in
-        for(unsigned int j = 0; j < total_ops; j++) {
-            // read in the draw op from disk
-            unsigned int draw_operation = 0;
-            fread(&draw_operation, sizeof(unsigned int), 1, to_read);
-
-            // see what draw op we have and read in as appropriate
-            if(draw_operation == POINT_CIRCLE)
-                loadPointCircle(ops[i], draw_operation, to_read);
-            else if(draw_operation == POINT_SQUARE)
-                loadPointSquare(ops[i], draw_operation, to_read);
-            else if(draw_operation == POINT_X)
-                loadPointX(ops[i], draw_operation, to_read);
-            else if(draw_operation == STRAIGHT_LINE_START)
-                loadStraightLineStart(ops[i], draw_operation, to_read);
-            else if(draw_operation == STRAIGHT_LINE_END)
-                loadStraightLineEnd(ops[i], draw_operation, to_read);
-            else if(draw_operation == LINE_END)
-                loadLineEnd(ops[i], draw_operation, to_read);
-            else if(draw_operation == LINE_POINT)
-                loadLinePoint(ops[i], draw_operation, to_read);
-            else if(draw_operation == LINE_START)
-                loadLineStart(ops[i], draw_operation, to_read);
-            else if(draw_operation == DRAW_TEXT)
-                loadText(ops[i], draw_operation, to_read);
-            else if(draw_operation == DRAW_RASTER)
-                loadRasterImage(ops[i], draw_operation, to_read, filename);
-            else if(draw_operation == DRAW_SVG)
-                loadSVGImage(ops[i], draw_operation, to_read, filename);
-        }
+        unsigned int thumbnail_size = readUInt(&section_reader);
+        const uchar *thumbnail = readSpan(&section_reader, thumbnail_size);
+        if(section_reader.failed)
+            return false;
+        thumbnails[i] = QByteArray((const char *) thumbnail, (int) thumbnail_size);
     }
+    return true;
+}
 
-    // read in the titles for each of the images
+// function that will read the cover and the thumbnail of each board out of a whiteboard file without loading any
+// of the boards. only the header and the previews after it are read in, which is a few kilobytes however large the
+// file is. this returns false if the file can't be read or has no previews
+bool loadPreviews(const QString &filename, QByteArray *cover, QVector<QByteArray> &thumbnails) {
+    // read in the header along with the size of the previews
+    QFile file(filename);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray start = file.read(WBD_HEADER_SIZE + sizeof(unsigned int));
+    if(start.size() != (int) (WBD_HEADER_SIZE + sizeof(unsigned int)))
+        return false;
+    unsigned int header[5] = {0, 0, 0, 0, 0};
+    memcpy(header, start.constData(), sizeof(header));
+    if(header[0] != WBD_MAGIC || header[1] > WBD_VERSION || !(header[2] & WBD_PREVIEWS) || header[4] > file.size())
+        return false;
+
+    // read in the rest of the previews and parse them out of what was read
+    start.append(file.read(header[4]));
+    WhiteboardReader reader;
+    reader.data = (const uchar *) start.constData();
+    reader.size = start.size();
+    reader.position = WBD_HEADER_SIZE;
+    reader.failed = false;
+    return loadPreviewSection(&reader, header[3], cover, thumbnails);
+}
+
+// function that will read in the header and board directory of a versioned whiteboard, along with the thumbnail of
+// each board if the file has them. this returns false if the header or directory is malformed or the file is from
+// a newer version than we understand
+bool loadBoardDirectory(WhiteboardReader *reader, unsigned int *flags, QVector<BoardEntry> &directory) {
+    // check the header is one we can read
+    unsigned int header[4] = {0, 0, 0, 0};
+    readBytes(reader, header, sizeof(header));
+    if(reader->failed || header[0] != WBD_MAGIC || header[1] > WBD_VERSION)
+        return false;
+    *flags = header[2];
+
+    // the previews sit between the header and the directory. only the thumbnails are needed here
+    unsigned int total_images = header[3];
+    QVector<QByteArray> thumbnails;
+    if((header[2] & WBD_PREVIEWS) && !loadPreviewSection(reader, total_images, NULL, thumbnails))
+        return false;
+
+    // every directory entry takes up a fixed amount of space before its title so check the number of images
+    // against what is left before reading in the entries. older files don't have the checksum of the title
+    bool title_checksums = header[1] >= WBD_TITLE_CHECKSUMS;
+    unsigned int entry_size = title_checksums ? WBD_DIRECTORY_ENTRY_SIZE : WBD_DIRECTORY_ENTRY_SIZE - sizeof(unsigned int);
+    if(total_images == 0 || total_images > (reader->size - reader->position) / entry_size)
+        return false;
+    directory.resize(total_images);
+
+    // read in each of the entries and make sure their boards sit inside the file. a title that doesn't match its
+    // checksum is dropped, the board itself is still checked against its own checksum when it is loaded
     for(unsigned int i = 0; i < total_images; i++) {
-        ops[i]->title = loadQString(to_read);
+        BoardEntry &entry = directory[i];
+        readBytes(reader, &entry.offset, sizeof(quint64));
+        entry.size = readUInt(reader);
+        entry.checksum = readUInt(reader);
+        entry.flags = readUInt(reader);
+        if(title_checksums) {
+            unsigned int title_checksum = readUInt(reader);
+            unsigned int title_length = readUInt(reader);
+            const uchar *title = readSpan(reader, title_length);
+            if(title != NULL && crc32c(title, title_length) == title_checksum)
+                entry.title = QString::fromUtf8((const char *) title, title_length);
+        } else
+            entry.title = loadQString(reader);
+        if(i < (unsigned int) thumbnails.size())
+            entry.thumbnail = thumbnails[i];
+        if(reader->failed || entry.offset > (quint64) reader->size || entry.size > (quint64) reader->size - entry.offset)
+            return false;
+    }
+    return true;
+}
+
+// function that will read in the asset table of a whiteboard with embedded images and load each of the images
+// from their bytes, which are checked against their checksum first. each image is added to assets with a
+// reference that the caller has to release. mapped images use their bytes where they are in the data, which then
+// has to stay around for as long as the images do. the reader is left after the bytes of the last image. this
+// returns false if the table or any of the images are damaged
+bool loadAssetTable(WhiteboardReader *reader, QString &filename, QVector<ImageAsset *> &assets, bool mapped) {
+    // every entry takes up a fixed amount of space before its path so check the number of images against what is
+    // left before reading in the entries
+    unsigned int total_assets = readUInt(reader);
+    if(reader->failed || total_assets > (reader->size - reader->position) / WBD_ASSET_ENTRY_SIZE)
+        return false;
+
+    // read in each of the entries and load its image if its bytes are all there and undamaged
+    qint64 assets_end = reader->position;
+    for(unsigned int i = 0; i < total_assets; i++) {
+        quint64 offset = 0;
+        readBytes(reader, &offset, sizeof(quint64));
+        unsigned int values[3] = {0, 0, 0};
+        readBytes(reader, values, sizeof(values));
+        const uchar *hash = readSpan(reader, ASSET_HASH_SIZE);
+        QString path = loadQString(reader);
+        if(reader->failed || offset > (quint64) reader->size || values[0] > (quint64) reader->size - offset)
+            return false;
+        const uchar *data = reader->data + offset;
+        if(crc32c(data, values[0]) != values[1] || (values[2] != DRAW_RASTER && values[2] != DRAW_SVG))
+            return false;
+        QString asset_filename = recreateAbsolutePath(filename, path);
+        QByteArray asset_hash((const char *) hash, ASSET_HASH_SIZE);
+        if(mapped)
+            assets.append(acquireMappedAsset(asset_filename, data, values[0], asset_hash, values[2] == DRAW_SVG));
+        else
+            assets.append(acquireEmbeddedAsset(asset_filename, data, values[0], asset_hash, values[2] == DRAW_SVG));
+        assets_end = qMax(assets_end, (qint64) (offset + values[0]));
+    }
+    reader->position = qMax(reader->position, assets_end);
+    return true;
+}
+
+// function that will decompress a compressed board into the given buffer. this returns false if the board is
+// damaged or uses a codec we don't know about
+bool decompressBoard(const uchar *data, unsigned int size, QByteArray &board) {
+    // read in the codec, level and size of the uncompressed board
+    unsigned int header[3] = {0, 0, 0};
+    if(size < COMPRESSION_HEADER_SIZE)
+        return false;
+    memcpy(header, data, COMPRESSION_HEADER_SIZE);
+    if(header[0] != COMPRESSION_ZLIB)
+        return false;
+
+    // decompress the board and make sure it came out the size it went in
+    board = qUncompress(data + COMPRESSION_HEADER_SIZE, (int) (size - COMPRESSION_HEADER_SIZE));
+    return (unsigned int) board.size() == header[2];
+}
+
+// function that will load a single board of a versioned whiteboard straight from its place in the data. the
+// images embedded in the file are looked up in assets. this returns null if the board is damaged
+DrawOperations *loadBoard(WhiteboardReader *reader, const BoardEntry &entry, QString &filename, QVector<ImageAsset *> &assets) {
+    // make sure the board is the same as when it was written
+    const uchar *data = reader->data + entry.offset;
+    if(crc32c(data, entry.size) != entry.checksum)
+        return NULL;
+
+    // compressed boards are decompressed and then parsed from there, everything else is parsed where it is
+    QByteArray decompressed;
+    qint64 size = entry.size;
+    if(entry.flags & BOARD_COMPRESSED) {
+        if(!decompressBoard(data, entry.size, decompressed))
+            return NULL;
+        data = (const uchar *) decompressed.constData();
+        size = decompressed.size();
+    }
+
+    // parse the board using a reader that only covers the board
+    WhiteboardReader board_reader;
+    board_reader.data = data;
+    board_reader.size = size;
+    board_reader.position = 0;
+    board_reader.failed = false;
+    DrawOperations *board = parseBoard(&board_reader, filename, assets, entry.flags);
+    if(board != NULL) {
+        board->title = entry.title;
+        board->thumbnail = entry.thumbnail;
+        board->thumbnail_ops = board->total_ops;
+        board->thumbnail_valid = !entry.thumbnail.isEmpty();
+    }
+    return board;
+}
+
+// function that will load every board in the directory at once, each one on its own task of a thread pool. the
+// boards only read from the data and the images so they don't get in each others way. the boards are returned in
+// the order of the directory with any that are damaged left as null
+void loadBoards(WhiteboardReader *reader, const QVector<BoardEntry> &directory, QString &filename, QVector<ImageAsset *> &assets, QVector<DrawOperations *> &boards) {
+    // a single board isn't worth starting any threads for
+    boards.fill(NULL, directory.size());
+    if(directory.size() == 1) {
+        boards[0] = loadBoard(reader, directory[0], filename, assets);
+        return;
+    }
+
+    // hand each board over to the pool and wait for all of them to be done
+    QThreadPool pool;
+    for(int i = 0; i < directory.size(); i++)
+        pool.start(new BoardLoadTask(reader, directory[i], filename, assets, &boards[i]));
+    pool.waitForDone();
+}
+
+// function that will start decoding every image used by the whiteboard on the global thread pool, so they are
+// ready by the time they are first drawn
+void queueAssetDecodes(DrawOperations **whiteboard, unsigned int total_images) {
+    QHash<QByteArray, unsigned int> seen;
+    QVector<ImageAsset *> assets;
+    for(unsigned int i = 0; i < total_images; i++)
+        collectAssets(whiteboard[i]->operations, 0, whiteboard[i]->total_ops, seen, assets);
+    for(int i = 0; i < assets.size(); i++)
+        QThreadPool::globalInstance()->start(new AssetDecodeTask(assets[i]));
+}
+
+// function that will apply a single batch of the journal to the boards. images embedded in the file are looked up
+// in and added to assets, which is null if the file doesn't embed its images. this returns false if any of the
+// records in the batch don't make sense for the boards
+bool replayJournalBatch(WhiteboardReader *reader, QVector<DrawOperations *> &boards, QString &filename, QVector<ImageAsset *> *assets) {
+    QVector<ImageAsset *> no_assets;
+    unsigned int flags = BOARD_DELTA_STROKES | (assets != NULL ? BOARD_EMBEDDED_ASSETS : 0);
+    while(reader->position < reader->size) {
+        // read in the type of record and the image it is for
+        unsigned int type = readUInt(reader);
+        unsigned int index = readUInt(reader);
+        if(reader->failed)
+            return false;
+
+        // new images are added to the end of the asset table. the record holds the draw operation, size, hash and
+        // path of the image followed by its bytes, which are covered by the checksum of the batch
+        if(type == JOURNAL_ASSET) {
+            if(assets == NULL || index != (unsigned int) assets->size())
+                return false;
+            unsigned int values[2] = {0, 0};
+            readBytes(reader, values, sizeof(values));
+            const uchar *hash = readSpan(reader, ASSET_HASH_SIZE);
+            QString path = loadQString(reader);
+            const uchar *data = readSpan(reader, values[1]);
+            if(reader->failed || (values[0] != DRAW_RASTER && values[0] != DRAW_SVG))
+                return false;
+            assets->append(acquireEmbeddedAsset(recreateAbsolutePath(filename, path), data, values[1], QByteArray((const char *) hash, ASSET_HASH_SIZE),
+                values[0] == DRAW_SVG));
+            continue;
+        }
+
+        // images can be inserted anywhere up to the end of the list and only images that exist can be deleted
+        if(type == JOURNAL_INSERT && index <= (unsigned int) boards.size()) {
+            boards.insert(index, (DrawOperations *) new DrawOperations());
+            continue;
+        }
+        if(index >= (unsigned int) boards.size())
+            return false;
+        if(type == JOURNAL_DELETE) {
+            delete boards[index];
+            boards.remove(index);
+            continue;
+        }
+        if(type != JOURNAL_UPDATE)
+            return false;
+
+        // take the image back to how many ops were kept, ignoring any lock as that is set again below
+        DrawOperations *board = boards[index];
+        unsigned int kept_ops = readUInt(reader);
+        unsigned int added_ops = readUInt(reader);
+        if(reader->failed || kept_ops > board->total_ops)
+            return false;
+        board->unlockImage();
+        while(board->total_ops > kept_ops)
+            board->removeLastDrawData();
+        if(board->total_ops != kept_ops)
+            return false;
+
+        // add on the new ops and then set the lock and title
+        if(!parseOps(reader, board, added_ops, filename, assets != NULL ? *assets : no_assets, flags))
+            return false;
+        unsigned char locked = 0;
+        readBytes(reader, &locked, sizeof(unsigned char));
+        unsigned int locked_op = readUInt(reader);
+        QString title = loadQString(reader);
+        if(reader->failed || locked_op > board->total_ops)
+            return false;
+        if(locked) {
+            board->locked = true;
+            board->locked_op = locked_op;
+        }
+        board->title = title;
+    }
+    return true;
+}
+
+// function that will apply the journal that starts at the current position of the reader to the boards. batches
+// are applied until one is missing or damaged, which is where the journal is taken to end. images embedded in the
+// file are looked up in and added to assets, which is null if the file doesn't embed its images. this returns false
+// if an undamaged batch doesn't make sense for the boards
+bool replayJournal(WhiteboardReader *reader, QVector<DrawOperations *> &boards, QString &filename, QVector<ImageAsset *> *assets, qint64 *journal_end) {
+    *journal_end = reader->position;
+    while(reader->size - reader->position >= JOURNAL_BATCH_HEADER_SIZE) {
+        // read in the header of the batch and make sure all of it made it to disk. a batch that didn't was being
+        // written when the application stopped and is ignored along with anything after it
+        unsigned int header[3] = {0, 0, 0};
+        readBytes(reader, header, sizeof(header));
+        if(header[0] != JOURNAL_MAGIC)
+            break;
+        const uchar *batch = readSpan(reader, header[1]);
+        if(batch == NULL || crc32c(batch, header[1]) != header[2])
+            break;
+
+        // apply the batch using a reader that only covers the batch
+        WhiteboardReader batch_reader;
+        batch_reader.data = batch;
+        batch_reader.size = header[1];
+        batch_reader.position = 0;
+        batch_reader.failed = false;
+        if(!replayJournalBatch(&batch_reader, boards, filename, assets))
+            return false;
+        *journal_end = reader->position;
+    }
+    return true;
+}
+
+// function that will replace every board that couldn't be loaded with an empty one holding the title from its
+// directory entry. this returns true if any of the boards were replaced
+bool replaceDamagedBoards(const QVector<BoardEntry> &directory, QVector<DrawOperations *> &boards) {
+    bool replaced = false;
+    for(int i = 0; i < boards.size(); i++) {
+        if(boards[i] != NULL)
+            continue;
+        boards[i] = (DrawOperations *) new DrawOperations();
+        boards[i]->title = directory[i].title;
+        replaced = true;
     }
+    return replaced;
+}
 
-    // close the file when we are finished
-    fclose(to_read);
+// function that will parse a versioned whiteboard out of the given data. a header and a directory of every
+// board come first, followed by the embedded images if there are any, then each of the boards and then the
+// journal of changes since they were written. the start and end of the journal and the images embedded in the
+// file are returned through journal. boards that are damaged are left empty and reported through damaged so the
+// rest of the whiteboard still loads. this returns null if the header, directory or images are malformed
+DrawOperations **parseWhiteboardV2(WhiteboardReader *reader, QString &filename, unsigned int *image_total, unsigned int *image_max, JournalState *journal, bool *damaged) {
+    // read in where each of the boards are
+    unsigned int flags = 0;
+    QVector<BoardEntry> directory;
+    if(!loadBoardDirectory(reader, &flags, directory))
+        return NULL;
+
+    // load in the embedded images. the ops of the boards only hold the ids of these
+    QVector<ImageAsset *> assets;
+    bool embedded = (flags & WBD_EMBEDDED_ASSETS) != 0;
+    bool success = !embedded || loadAssetTable(reader, filename, assets, false);
+
+    // load all of the boards in from where they are at the same time, the journal starts straight after the last
+    // of them
+    QVector<DrawOperations *> boards;
+    quint64 boards_end = reader->position;
+    if(success)
+        loadBoards(reader, directory, filename, assets, boards);
+    for(int i = 0; i < directory.size(); i++)
+        boards_end = qMax(boards_end, directory[i].offset + directory[i].size);
+    *damaged = replaceDamagedBoards(directory, boards);
+
+    // apply the journal to the boards. the journal can hold changes to a damaged board that make no sense for its
+    // empty replacement, in which case the boards are loaded again and the journal is left out
+    qint64 journal_end = 0;
+    reader->position = boards_end;
+    if(success && !replayJournal(reader, boards, filename, embedded ? &assets : NULL, &journal_end)) {
+        for(int i = 0; i < boards.size(); i++)
+            delete boards[i];
+        boards.clear();
+        success = *damaged;
+        if(success) {
+            loadBoards(reader, directory, filename, assets, boards);
+            replaceDamagedBoards(directory, boards);
+            journal_end = boards_end;
+        }
+    }
+    success = success && boards.size() > 0;
+
+    // the boards now hold their own references to the images so ours can go, after remembering the id of each
+    QHash<QByteArray, unsigned int> asset_ids;
+    for(int i = 0; i < assets.size(); i++) {
+        if(!asset_ids.contains(assets[i]->hash))
+            asset_ids.insert(assets[i]->hash, i);
+        releaseImageAsset(assets[i]);
+    }
+
+    // throw away the boards if the images were damaged or the journal didn't make sense
+    if(!success) {
+        for(int i = 0; i < boards.size(); i++)
+            delete boards[i];
+        return NULL;
+    }
+
+    // move the boards into our draw images and mark them as saved
+    unsigned int total_images = boards.size();
+    unsigned int max_images = 0;
+    DrawOperations **ops = allocateWhiteboard(total_images, &max_images);
+    for(unsigned int i = 0; i < total_images; i++) {
+        ops[i] = boards[i];
+        for(unsigned int journal = 0; journal < TOTAL_JOURNALS; journal++)
+            ops[i]->markJournalled(journal);
+    }
 
     // any images that have not been loaded fill them with empty images
     for(unsigned int i = total_images; i < max_images; i++)
         ops[i] = (DrawOperations *) new DrawOperations();
 
-    // return the images, max images, and total images
+    // return the images, max images, total images and where the journal is
     *image_max = max_images;
     *image_total = total_images;
+    journal->filename = filename;
+    journal->start = boards_end;
+    journal->end = journal_end;
+    journal->embedded = embedded;
+    journal->assets = asset_ids;
     return ops;
 }
 
+// function that will load a whiteboard from disk. the file is mapped into memory and parsed straight out of the
+// mapping. the journal of the file is returned through journal and whether any boards were damaged and left empty
+// through damaged. this returns null if the file can't be read or is malformed
+DrawOperations **loadWhiteboard(QString &filename, unsigned int *image_total, unsigned int *image_max, JournalState *journal, bool *damaged) {
+    // open the file for reading and map it in
+    QFile file(filename);
+    WhiteboardReader reader;
+    QByteArray contents;
+    if(!mapWhiteboardFile(file, &reader, contents))
+        return NULL;
+
+    // versioned files start with the magic number, anything else is in the original format. the original format
+    // has no journal so the first save to it has to rewrite the whole file. the mapping goes away when the file
+    // is closed
+    unsigned int magic = 0;
+    if(reader.size >= (qint64) sizeof(unsigned int))
+        memcpy(&magic, reader.data, sizeof(unsigned int));
+    DrawOperations **ops = NULL;
+    *damaged = false;
+    if(magic == WBD_MAGIC) {
+        ops = parseWhiteboardV2(&reader, filename, image_total, image_max, journal, damaged);
+    } else {
+        journal->filename = QString("");
+        journal->embedded = false;
+        journal->assets.clear();
+        ops = parseWhiteboardV1(&reader, filename, image_total, image_max);
+        for(unsigned int i = 0; ops != NULL && i < *image_total; i++) {
+            for(unsigned int journal = 0; journal < TOTAL_JOURNALS; journal++)
+                ops[i]->markJournalled(journal);
+        }
+    }
+
+    // get the images decoding in the background while the whiteboard is put on screen
+    if(ops != NULL)
+        queueAssetDecodes(ops, *image_total);
+    return ops;
+}
+
+// function that will open the given file and point the reader at the whole of it. the file is mapped into memory
+// and if it can't be mapped then it is read into contents instead. the data stays around until the file is closed
+// or contents goes away. this returns false if the file can't be opened
+bool mapWhiteboardFile(QFile &file, WhiteboardReader *reader, QByteArray &contents) {
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+    reader->size = file.size();
+    reader->position = 0;
+    reader->failed = false;
+    reader->data = reader->size > 0 ? file.map(0, reader->size) : NULL;
+    if(reader->data == NULL) {
+        contents = file.readAll();
+        reader->data = (const uchar *) contents.constData();
+        reader->size = contents.size();
+    }
+    return true;
+}
+
 // function that will recreate an absolute path from the current file location and a relative path
 QString recreateAbsolutePath(QString whiteboard_path, QString relative_path) {
     // the full path to be returned
@@ -347,178 +935,518 @@ QString recreateAbsolutePath(QString whiteboard_path, QString relative_path) {
     return full_path;
 }
 
-// function that will write a line end to disk
-void saveLineEnd(DrawOp *point, FILE *to_write) {
-    // get a reference to a point circle and write it to disk in one go
-    LineEnd *temp = (LineEnd *) point;
-    fwrite(temp, sizeof(LineEnd), 1, to_write);
-}
-
-// function that will write a line start to disk
-void saveLineStart(DrawOp *point, FILE *to_write) {
-    // get a reference to a point circle and write it to disk in one go
-    LineStart *temp = (LineStart *) point;
-    fwrite(temp, sizeof(LineStart), 1, to_write);
+// function that will append the raw bytes of a value to the end of the buffer
+void saveBytes(const void *data, unsigned int length, QByteArray &buffer) {
+    buffer.append((const char *) data, (int) length);
 }
 
-// function that will write a line point to disk
-void saveLinePoint(DrawOp *point, FILE *to_write) {
-    // get a reference to a point circle and write it to disk in one go
-    LinePoint *temp = (LinePoint *) point;
-    fwrite(temp, sizeof(LinePoint), 1, to_write);
-}
-
-// function that will write the given point circle to disk
-void savePointCircle(DrawOp *point, FILE *to_write) {
-    // get a reference to a point circle and write it to disk in one go
-    PointCircle *temp = (PointCircle *) point;
-    fwrite(temp, sizeof(PointCircle), 1, to_write);
-}
-
-// function that will write the given point circle to disk
-void savePointSquare(DrawOp *point, FILE *to_write) {
-    // get a reference to a point square and write it to disk in one go
-    PointSquare *temp = (PointSquare *) point;
-    fwrite(temp, sizeof(PointSquare), 1, to_write);
-}
-
-// function that will write the given point x to disk
-void savePointX(DrawOp *point, FILE *to_write) {
-    // get a reference to a point X and write it to disk in one go
-    PointX *temp = (PointX *) point;
-    fwrite(temp, sizeof(PointX), 1, to_write);
+// function that will write a run of point and line operations into the buffer. each operation is written in the
+// same 20 byte layout it has in memory so the buffer is grown once and the records are copied straight in
+void savePointRun(DrawOp *run, unsigned int count, QByteArray &buffer) {
+    // grow the buffer to fit the whole run
+    int offset = buffer.size();
+    buffer.resize(offset + (int)(count * sizeof(PointOp)));
+
+    // copy each of the records into place
+    char *data = buffer.data() + offset;
+    for(unsigned int i = 0; i < count; i++) {
+        memcpy(data, &run[i], sizeof(PointOp));
+        data += sizeof(PointOp);
+    }
 }
 
-// function that will take a qstring and will write it to disk
+// function that will take a qstring and will write it into the buffer
 // it will do so by figuring out its length, write that first and then write the byte array
-void saveQString(QString *string, FILE *to_write) {
+void saveQString(QString *string, QByteArray &buffer) {
     // get the byte array from the string in UTF-8 format and get the length of that byte array
     QByteArray ba_string = string->toUtf8();
     unsigned int length = (unsigned int) ba_string.size();
 
-    // write the length and the bytes to disk
-    const char *data = ba_string.data();
-    fwrite(&length, sizeof(unsigned int), 1, to_write);
-    fwrite(data, sizeof(char), length, to_write);
+    // write the length and the bytes into the buffer
+    saveBytes(&length, sizeof(unsigned int), buffer);
+    buffer.append(ba_string);
 }
 
-// function that will write a raster image operation to disk
-void saveRasterImage(DrawOp *raster, FILE *to_write, QString &filename) {
+// function that will write a raster image operation into the buffer. if assets is given the image is written as
+// its id in the file, otherwise as the path to it
+void saveRasterImage(DrawOp *raster, QByteArray &buffer, QString &filename, const QHash<QByteArray, unsigned int> *assets) {
     // get a reference to a raster image
     RasterImage *temp = (RasterImage *) raster;
 
-    // write all of the integer fields one by one to disk
-    fwrite(&temp->draw_operation, sizeof(unsigned int), 1, to_write);
-    fwrite(&temp->x, sizeof(int), 1, to_write);
-    fwrite(&temp->y, sizeof(int), 1, to_write);
-    fwrite(&temp->width, sizeof(int), 1, to_write);
-    fwrite(&temp->height, sizeof(int), 1, to_write);
+    // the draw operation and the four integer fields sit next to each other so write them in one go
+    saveBytes(&temp->draw_operation, 5 * sizeof(int), buffer);
+
+    // embedded images just need their id
+    if(assets != NULL) {
+        unsigned int id = assets->value(temp->asset->hash);
+        saveBytes(&id, sizeof(unsigned int), buffer);
+        return;
+    }
 
-    // write the string filename to disk using a relative path
-    QString relative = determineRelativePath(filename, *temp->filename);
-    saveQString(&relative, to_write);
+    // write the string filename using a relative path
+    QString relative = determineRelativePath(filename, temp->asset->filename);
+    saveQString(&relative, buffer);
 }
 
-// function that will write the straight line start to disk
-void saveStraightLineStart(DrawOp *point, FILE *to_write) {
-    // get a reference to a straight line start and write it to disk in one go
-    StraightLineStart *temp = (StraightLineStart *) point;
-    fwrite(temp, sizeof(StraightLineStart), 1, to_write);
+// function that will write an SVG image into the buffer. if assets is given the image is written as its id in the
+// file, otherwise as the path to it
+void saveSVGImage(DrawOp *svg, QByteArray &buffer, QString &filename, const QHash<QByteArray, unsigned int> *assets) {
+    // get a reference to the SVG image
+    SVGImage *temp = (SVGImage *) svg;
+
+    // the draw operation and the four integer fields sit next to each other so write them in one go
+    saveBytes(&temp->draw_operation, 5 * sizeof(int), buffer);
+
+    // embedded images just need their id
+    if(assets != NULL) {
+        unsigned int id = assets->value(temp->asset->hash);
+        saveBytes(&id, sizeof(unsigned int), buffer);
+        return;
+    }
+
+    // write the string filename using a relative path
+    QString relative = determineRelativePath(filename, temp->asset->filename);
+    saveQString(&relative, buffer);
 }
 
-// function that will write the straight line end to disk
-void saveStraightLineEnd(DrawOp *point, FILE *to_write) {
-    // get a reference to a straight line start and write it to disk in one go
-    StraightLineEnd *temp = (StraightLineEnd *) point;
-    fwrite(temp, sizeof(StraightLineStart), 1, to_write);
+// function that will write an unsigned value into the buffer as a varint. each byte holds seven bits of the value
+// with the top bit set on every byte but the last, so small values only take up a single byte
+void saveVarint(unsigned int value, QByteArray &buffer) {
+    while(value >= 0x80) {
+        buffer.append((char) ((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    buffer.append((char) value);
 }
 
-// function that will write an SVG image to disk
-void saveSVGImage(DrawOp *svg, FILE *to_write, QString &filename) {
-    // get a reference to the SVG image
-    SVGImage *temp = (SVGImage *) svg;
+// function that will work out how many ops from the given position make up a freehand line that can be written as a
+// stroke. this is a line start followed by line points and a line end that all share the same colour and size, or
+// a line start on its own. zero is returned if the ops can't be written as a stroke
+unsigned int strokeLength(DrawOp *operations, unsigned int position, unsigned int total_ops) {
+    // strokes always begin with the start of a line
+    PointOp *start = (PointOp *) &operations[position];
+    if(start->draw_operation != LINE_START)
+        return 0;
+
+    // run through the points of the line until we get to its end
+    unsigned int end = position + 1;
+    while(end < total_ops) {
+        PointOp *point = (PointOp *) &operations[end];
+        if(point->draw_operation != LINE_POINT && point->draw_operation != LINE_END)
+            break;
+        if(point->colour != start->colour || point->size != start->size)
+            return 0;
+        end++;
+        if(point->draw_operation == LINE_END)
+            return end - position;
+    }
 
-    // write all of the integer fields one by one to disk
-    fwrite(&temp->draw_operation, sizeof(unsigned int), 1, to_write);
-    fwrite(&temp->x, sizeof(int), 1, to_write);
-    fwrite(&temp->y, sizeof(int), 1, to_write);
-    fwrite(&temp->width, sizeof(int), 1, to_write);
-    fwrite(&temp->height, sizeof(int), 1, to_write);
+    // a line start on its own is fine but a line that never reaches its end can't be rebuilt from a stroke
+    return end == position + 1 ? 1 : 0;
+}
 
-    // write the string filename to disk
-    QString relative = determineRelativePath(filename, *temp->filename);
-    saveQString(&relative, to_write);
+// function that will write a freehand line into the buffer as a stroke. the colour, size and number of points
+// come first followed by the zig-zag coded difference of each point from the one before it
+void saveStroke(DrawOp *operations, unsigned int count, QByteArray &buffer) {
+    // write the header of the stroke
+    PointOp *start = (PointOp *) operations;
+    saveBytes(&FILE_STROKE, sizeof(unsigned int), buffer);
+    saveBytes(&start->colour, sizeof(unsigned int), buffer);
+    saveBytes(&start->size, sizeof(int), buffer);
+    saveVarint(count, buffer);
+
+    // write the difference of each point. zig-zag coding moves the sign into the bottom bit so that small negative
+    // differences stay small. the first point is the difference from zero
+    unsigned int x = 0, y = 0;
+    for(unsigned int i = 0; i < count; i++) {
+        PointOp *point = (PointOp *) &operations[i];
+        int dx = (int) ((unsigned int) point->x - x);
+        int dy = (int) ((unsigned int) point->y - y);
+        saveVarint(((unsigned int) dx << 1) ^ (unsigned int) (dx >> 31), buffer);
+        saveVarint(((unsigned int) dy << 1) ^ (unsigned int) (dy >> 31), buffer);
+        x = (unsigned int) point->x;
+        y = (unsigned int) point->y;
+    }
 }
 
-// function that will write a text operation to disk
-void saveText(DrawOp *text, FILE *to_write) {
+// function that will write a text operation into the buffer
+void saveText(DrawOp *text, QByteArray &buffer) {
     // get a reference to a text
     Text *temp = (Text *) text;
 
-    // write all of the integer fields one by one to disk
-    fwrite(&temp->draw_operation, sizeof(unsigned int), 1, to_write);
-    fwrite(&temp->x, sizeof(int), 1, to_write);
-    fwrite(&temp->y, sizeof(int), 1, to_write);
-    fwrite(&temp->colour, sizeof(unsigned int), 1, to_write);
-    fwrite(&temp->size, sizeof(int), 1, to_write);
-    fwrite(&temp->rotation, sizeof(int), 1, to_write);
+    // the draw operation and the five integer fields sit next to each other so write them in one go
+    saveBytes(&temp->draw_operation, 6 * sizeof(int), buffer);
 
-    // write the string filename to disk
-    saveQString(temp->string, to_write);
+    // write the text itself
+    saveQString(temp->string, buffer);
+}
+
+// function that will serialise the ops [start, end) of the given operations onto the end of the buffer. freehand
+// lines are written as strokes so whatever holds the ops must be marked with BOARD_DELTA_STROKES. if assets is
+// given images are written as their id in it and whatever holds the ops must be marked with BOARD_EMBEDDED_ASSETS
+void serialiseOps(QString &filename, DrawOp *operations, unsigned int start, unsigned int end, const QHash<QByteArray, unsigned int> *assets, QByteArray &buffer) {
+    // go through each of the ops and write them depending on what ops we have
+    unsigned int j = start;
+    while(j < end) {
+        // freehand lines are written as strokes
+        unsigned int length = strokeLength(operations, j, end);
+        if(length > 0) {
+            saveStroke(&operations[j], length, buffer);
+            j += length;
+            continue;
+        }
 
+        // any other point and line operations are written as a run in one go, stopping at the next stroke
+        if(isPointOp(operations[j].draw_operation)) {
+            unsigned int run_end = j + 1;
+            while(run_end < end && isPointOp(operations[run_end].draw_operation) && operations[run_end].draw_operation != LINE_START)
+                run_end++;
+            savePointRun(&operations[j], run_end - j, buffer);
+            j = run_end;
+            continue;
+        }
+
+        // see what operation we have and write it with the appropriate method
+        if(operations[j].draw_operation == DRAW_TEXT)
+            saveText(&operations[j], buffer);
+        else if(operations[j].draw_operation == DRAW_RASTER)
+            saveRasterImage(&operations[j], buffer, filename, assets);
+        else if(operations[j].draw_operation == DRAW_SVG)
+            saveSVGImage(&operations[j], buffer, filename, assets);
+        j++;
+    }
+}
+
+// function that will serialise a single board onto the end of the buffer. this is the total ops, the locked op
+// and the locked state followed by the ops themselves. freehand lines are written as strokes so the board must be
+// marked with BOARD_DELTA_STROKES, and if assets is given it must be marked with BOARD_EMBEDDED_ASSETS as well
+void serialiseBoard(QString &filename, DrawOperations *board, const QHash<QByteArray, unsigned int> *assets, QByteArray &buffer) {
+    // write the total ops, the lock ops and lock state first
+    saveBytes(&board->total_ops, sizeof(unsigned int), buffer);
+    saveBytes(&board->locked_op, sizeof(unsigned int), buffer);
+    saveBytes(&board->locked, sizeof(bool), buffer);
+
+    // write all of the ops of the board
+    serialiseOps(filename, board->operations, 0, board->total_ops, assets, buffer);
+}
+
+// function that will go through the ops [start, end) of the given operations and give every image that doesn't
+// have an id in assets the next one. the images that were given an id are added to added in the order of their ids
+void collectAssets(DrawOp *operations, unsigned int start, unsigned int end, QHash<QByteArray, unsigned int> &assets, QVector<ImageAsset *> &added) {
+    for(unsigned int i = start; i < end; i++) {
+        if(operations[i].draw_operation != DRAW_RASTER && operations[i].draw_operation != DRAW_SVG)
+            continue;
+        ImageAsset *asset = operations[i].draw_operation == DRAW_RASTER ? operations[i].raster_image.asset : operations[i].svg_image.asset;
+        if(assets.contains(asset->hash))
+            continue;
+        assets.insert(asset->hash, assets.size());
+        added.append(asset);
+    }
+}
+
+// function that will serialise the asset table for the given images onto the end of the buffer, followed by the
+// bytes of each of the images. the images are given their position in the list as their id
+void serialiseAssetTable(QString &filename, const QVector<ImageAsset *> &assets, QByteArray &buffer) {
+    // the paths are needed up front to know how big the table will be and so where the bytes of each image go
+    QVector<QString> paths(assets.size());
+    quint64 offset = buffer.size() + sizeof(unsigned int);
+    for(int i = 0; i < assets.size(); i++) {
+        paths[i] = determineRelativePath(filename, assets[i]->filename);
+        offset += WBD_ASSET_ENTRY_SIZE + paths[i].toUtf8().size();
+    }
+
+    // write the number of images and then an entry for each of them
+    unsigned int total_assets = assets.size();
+    saveBytes(&total_assets, sizeof(unsigned int), buffer);
+    for(int i = 0; i < assets.size(); i++) {
+        const QByteArray &data = assets[i]->data;
+        unsigned int values[3] = {(unsigned int) data.size(), crc32c((const uchar *) data.constData(), data.size()), assets[i]->vector ? DRAW_SVG : DRAW_RASTER};
+        saveBytes(&offset, sizeof(quint64), buffer);
+        saveBytes(values, sizeof(values), buffer);
+        buffer.append(assets[i]->hash);
+        saveQString(&paths[i], buffer);
+        offset += data.size();
+    }
+
+    // write the bytes of the images one after the other
+    for(int i = 0; i < assets.size(); i++)
+        buffer.append(assets[i]->data);
 }
 
-// function that will take a whiteboard and write it to disk
-void saveWhiteboard(QString &filename, DrawOperations **whiteboard, unsigned int total_images) {
-    // open up the file for writing in binary mode
-    FILE *to_write = fopen(filename.toStdString().c_str(), "wb");
+// function that will take a snapshot of the whiteboard that shares the draw operations of every image, so it
+// costs next to nothing to take. the snapshot stays as it is while the whiteboard carries on being changed and
+// can be read on another thread. it should be deleted with freeWhiteboard on the thread the whiteboard lives on
+DrawOperations **snapshotWhiteboard(DrawOperations **whiteboard, unsigned int total_images) {
+    DrawOperations **snapshot = (DrawOperations **) new DrawOperations *[total_images];
+    for(unsigned int i = 0; i < total_images; i++)
+        snapshot[i] = (DrawOperations *) new DrawOperations(whiteboard[i]);
+    return snapshot;
+}
 
-    // write the numbers for images to the file
-    fwrite(&total_images, sizeof(unsigned int), 1, to_write);
+// function that will tell us if the image has changed since it was last written to the file of the given journal
+bool hasBoardChanges(DrawOperations *board, unsigned int journal) {
+    JournalMark &mark = board->journal_marks[journal];
+    return mark.low != mark.ops || board->total_ops != mark.ops || board->title != mark.title || board->locked != mark.locked ||
+        board->locked_op != mark.locked_op;
+}
 
-    // go through each of the images in turn
+// function that will tell us if anything in the whiteboard has changed since it was last written to the file of
+// the given journal
+bool hasJournalChanges(DrawOperations **whiteboard, unsigned int total_images, const QVector<JournalEvent> &events, unsigned int journal) {
+    if(!events.isEmpty())
+        return true;
     for(unsigned int i = 0; i < total_images; i++) {
-        // write the total ops, the lock ops and lock state to the file first
-        fwrite(&whiteboard[i]->total_ops, sizeof(unsigned int), 1, to_write);
-        fwrite(&whiteboard[i]->locked_op, sizeof(unsigned int), 1, to_write);
-        fwrite(&whiteboard[i]->locked, sizeof(bool), 1, to_write);
-
-        // go through each of the ops in the image and write them to disk depnding on what ops we have
-        for(unsigned int j = 0; j < whiteboard[i]->total_ops; j++) {
-            // pull out the current operation as we will be referencing it a lot
-            DrawOp *temp = &whiteboard[i]->operations[j];
-
-            // see what operation we have and write it to disk with the appropriate method
-            if(temp->draw_operation == POINT_CIRCLE)
-                savePointCircle(temp, to_write);
-            else if(temp->draw_operation == POINT_SQUARE)
-                savePointSquare(temp, to_write);
-            else if(temp->draw_operation == POINT_X)
-                savePointX(temp, to_write);
-            else if(temp->draw_operation == STRAIGHT_LINE_START)
-                saveStraightLineStart(temp, to_write);
-            else if(temp->draw_operation == STRAIGHT_LINE_END)
-                saveStraightLineEnd(temp, to_write);
-            else if(temp->draw_operation == LINE_START)
-                saveLineStart(temp, to_write);
-            else if(temp->draw_operation == LINE_POINT)
-                saveLinePoint(temp, to_write);
-            else if(temp->draw_operation == LINE_END)
-                saveLineEnd(temp, to_write);
-            else if(temp->draw_operation == DRAW_TEXT)
-                saveText(temp, to_write);
-            else if(temp->draw_operation == DRAW_RASTER)
-                saveRasterImage(temp, to_write, filename);
-            else if(temp->draw_operation == DRAW_SVG)
-                saveSVGImage(temp, to_write, filename);
-        }
+        if(hasBoardChanges(whiteboard[i], journal))
+            return true;
+    }
+    return false;
+}
+
+// function that will serialise everything that has changed in the whiteboard since it was last saved into a
+// single batch of the journal. if the file embeds its images then any images it doesn't have yet are added to
+// assets and written first. the inserts and deletes of images come next followed by an update for every image
+// that has changed. nothing is written if nothing has changed
+void serialiseJournal(QString &filename, DrawOperations **whiteboard, unsigned int total_images, const QVector<JournalEvent> &events, unsigned int journal, QHash<QByteArray, unsigned int> *assets, QByteArray &buffer) {
+    // write any new images along with their bytes so the updates can refer to them
+    QByteArray batch;
+    QVector<ImageAsset *> added;
+    for(unsigned int i = 0; assets != NULL && i < total_images; i++) {
+        if(hasBoardChanges(whiteboard[i], journal))
+            collectAssets(whiteboard[i]->operations, whiteboard[i]->journal_marks[journal].low, whiteboard[i]->total_ops, *assets, added);
+    }
+    unsigned int first_id = assets != NULL ? assets->size() - added.size() : 0;
+    for(int i = 0; i < added.size(); i++) {
+        QString path = determineRelativePath(filename, added[i]->filename);
+        unsigned int values[4] = {JOURNAL_ASSET, first_id + i, added[i]->vector ? DRAW_SVG : DRAW_RASTER, (unsigned int) added[i]->data.size()};
+        saveBytes(values, sizeof(values), batch);
+        batch.append(added[i]->hash);
+        saveQString(&path, batch);
+        batch.append(added[i]->data);
+    }
+
+    // write each of the inserts and deletes in the order they happened
+    for(int i = 0; i < events.size(); i++) {
+        saveBytes(&events[i].type, sizeof(unsigned int), batch);
+        saveBytes(&events[i].index, sizeof(unsigned int), batch);
+    }
+
+    // write an update for each of the images that don't match the file anymore
+    for(unsigned int i = 0; i < total_images; i++) {
+        DrawOperations *board = whiteboard[i];
+        JournalMark &mark = board->journal_marks[journal];
+        if(!hasBoardChanges(board, journal))
+            continue;
+
+        // the update keeps the ops up to the lowest point the image was undone to and adds everything after it
+        unsigned int values[4] = {JOURNAL_UPDATE, i, mark.low, board->total_ops - mark.low};
+        saveBytes(values, sizeof(values), batch);
+        serialiseOps(filename, board->operations, mark.low, board->total_ops, assets, batch);
+        saveBytes(&board->locked, sizeof(bool), batch);
+        saveBytes(&board->locked_op, sizeof(unsigned int), batch);
+        saveQString(&board->title, batch);
+    }
+
+    // put the header on the batch
+    if(batch.isEmpty())
+        return;
+    unsigned int header[3] = {JOURNAL_MAGIC, (unsigned int) batch.size(), crc32c((const uchar *) batch.constData(), batch.size())};
+    saveBytes(header, sizeof(header), buffer);
+    buffer.append(batch);
+}
+
+// function that will append everything that has changed in the whiteboard since it was last saved to the journal
+// of the file it was saved to, using the marks of the given journal in each image. anything after the end of the
+// journal, such as a batch that was only partly written, is cut off first. progress may be null, if it is cancelled
+// nothing is written. this returns false if the journal could not be written
+bool appendJournal(DrawOperations **whiteboard, unsigned int total_images, const QVector<JournalEvent> &events, unsigned int journal_index, JournalState *journal, TaskProgress *progress) {
+    // work out what needs to be written
+    QByteArray buffer;
+    serialiseJournal(journal->filename, whiteboard, total_images, events, journal_index, journal->embedded ? &journal->assets : NULL, buffer);
+    if(progress != NULL)
+        progress->done.fetchAndAddRelease(total_images);
+    if(buffer.isEmpty())
+        return true;
+    if(progress != NULL && progress->cancelled.loadAcquire())
+        return false;
+
+    // open the file and cut it back to where the journal ends
+    QFile file(journal->filename);
+    if(!file.open(QIODevice::ReadWrite) || file.size() < journal->end || !file.resize(journal->end))
+        return false;
+
+    // write the batch on the end and make sure it has reached the disk
+    if(!file.seek(journal->end) || file.write(buffer) != buffer.size() || !file.flush() || fsync(file.handle()) != 0)
+        return false;
+    journal->end += buffer.size();
+    return true;
+}
+
+// function that will compress the board at the end of the buffer starting from the given offset. the board is
+// only replaced if compressing it makes it smaller, true is returned if it was replaced
+bool compressBoard(QByteArray &buffer, int offset, int compression_level) {
+    // compress the board
+    int size = buffer.size() - offset;
+    QByteArray compressed = qCompress((const uchar *) buffer.constData() + offset, size, compression_level);
+    if(compressed.size() + (int) COMPRESSION_HEADER_SIZE >= size)
+        return false;
+
+    // swap the board for its header and compressed bytes
+    unsigned int header[3] = {COMPRESSION_ZLIB, (unsigned int) compression_level, (unsigned int) size};
+    buffer.truncate(offset);
+    saveBytes(header, COMPRESSION_HEADER_SIZE, buffer);
+    buffer.append(compressed);
+    return true;
+}
+
+// function that will compress an image into the bytes of a preview for a whiteboard file. previews are JPEG as
+// they are only ever looked at and are much smaller than they would be as PNG
+QByteArray encodePreview(const QImage &image) {
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "JPG", PREVIEW_QUALITY);
+    return data;
+}
+
+// function that will serialise a whole whiteboard into the buffer. the header, the previews and a directory of
+// every board come first, followed by each of the boards so any one board can be found without reading the
+// others. each board is compressed at the given level, zero means the boards are left uncompressed. boards whose
+// thumbnail is out of date are written without one. if assets is given every image is embedded once in the file
+// after the directory and the id of each image is returned through it. if progress is given it is updated after
+// each board and the serialising stops early returning false if it is cancelled
+bool serialiseWhiteboard(QString &filename, DrawOperations **whiteboard, unsigned int total_images, QByteArray &buffer, int compression_level, const QByteArray &cover, QHash<QByteArray, unsigned int> *assets, TaskProgress *progress) {
+    // the previews are already compressed so they can be put together straight away
+    QByteArray previews;
+    unsigned int preview_size = cover.size();
+    saveBytes(&preview_size, sizeof(unsigned int), previews);
+    previews.append(cover);
+    for(unsigned int i = 0; i < total_images; i++) {
+        QByteArray thumbnail = whiteboard[i]->thumbnailCurrent() ? whiteboard[i]->thumbnail : QByteArray();
+        preview_size = thumbnail.size();
+        saveBytes(&preview_size, sizeof(unsigned int), previews);
+        previews.append(thumbnail);
+    }
+
+    // the titles are needed up front to know how big the directory will be
+    QVector<BoardEntry> directory(total_images);
+    unsigned int directory_size = 0;
+    unsigned int board_flags = BOARD_DELTA_STROKES | (assets != NULL ? BOARD_EMBEDDED_ASSETS : 0);
+    for(unsigned int i = 0; i < total_images; i++) {
+        directory[i].title = whiteboard[i]->title;
+        directory[i].flags = board_flags;
+        directory_size += WBD_DIRECTORY_ENTRY_SIZE + directory[i].title.toUtf8().size();
+    }
+    unsigned int header_size = WBD_HEADER_SIZE + sizeof(unsigned int) + previews.size() + directory_size;
+
+    // find every image the boards use so each one is only written once
+    QVector<ImageAsset *> added;
+    for(unsigned int i = 0; assets != NULL && i < total_images; i++)
+        collectAssets(whiteboard[i]->operations, 0, whiteboard[i]->total_ops, *assets, added);
+
+    // make a rough guess at how big the whiteboard is so the buffer doesn't need to grow while we write it
+    unsigned int estimate = header_size;
+    for(unsigned int i = 0; i < total_images; i++)
+        estimate += 64 + whiteboard[i]->total_ops * 4;
+    for(int i = 0; i < added.size(); i++)
+        estimate += WBD_ASSET_ENTRY_SIZE + added[i]->data.size();
+    buffer.reserve((int) estimate);
+
+    // leave room for the header, previews and directory, put the embedded images after them and then write each
+    // of the boards, remembering where each one ended up and its checksum
+    buffer.resize(header_size);
+    if(assets != NULL)
+        serialiseAssetTable(filename, added, buffer);
+    for(unsigned int i = 0; i < total_images; i++) {
+        if(progress != NULL && progress->cancelled.loadAcquire())
+            return false;
+        int offset = buffer.size();
+        serialiseBoard(filename, whiteboard[i], assets, buffer);
+        if(compression_level > 0 && compressBoard(buffer, offset, compression_level))
+            directory[i].flags |= BOARD_COMPRESSED;
+        directory[i].offset = offset;
+        directory[i].size = buffer.size() - offset;
+        directory[i].checksum = crc32c((const uchar *) buffer.constData() + offset, directory[i].size);
+        if(progress != NULL)
+            progress->done.ref();
     }
 
-    // write all the image titles to disk
+    // now everything is known fill in the header, the previews and the directory
+    QByteArray header;
+    unsigned int values[5] = {WBD_MAGIC, WBD_VERSION, WBD_PREVIEWS | (assets != NULL ? WBD_EMBEDDED_ASSETS : 0), total_images, (unsigned int) previews.size()};
+    saveBytes(values, sizeof(values), header);
+    header.append(previews);
     for(unsigned int i = 0; i < total_images; i++) {
-        saveQString(&whiteboard[i]->title, to_write);
+        saveBytes(&directory[i].offset, sizeof(quint64), header);
+        saveBytes(&directory[i].size, sizeof(unsigned int), header);
+        saveBytes(&directory[i].checksum, sizeof(unsigned int), header);
+        saveBytes(&directory[i].flags, sizeof(unsigned int), header);
+        QByteArray title = directory[i].title.toUtf8();
+        unsigned int title_checksum = crc32c((const uchar *) title.constData(), title.size());
+        saveBytes(&title_checksum, sizeof(unsigned int), header);
+        saveQString(&directory[i].title, header);
     }
+    buffer.replace(0, header.size(), header);
+    return true;
+}
+
+// function that will take a whiteboard and write it to disk, compressing each board at the given level and
+// embedding its images if asked to. the cover and the thumbnails of the boards go in at the start of the file. the
+// file is written without a journal and where the journal will start is returned through journal. progress may be
+// null, if it is cancelled the file is left as it was. this returns false if the file could not be written
+bool saveWhiteboard(QString &filename, DrawOperations **whiteboard, unsigned int total_images, int compression_level, bool embed_assets, const QByteArray &cover, JournalState *journal, TaskProgress *progress) {
+    // serialise everything into memory and then write it out in one go
+    QByteArray buffer;
+    QHash<QByteArray, unsigned int> assets;
+    if(!serialiseWhiteboard(filename, whiteboard, total_images, buffer, compression_level, cover, embed_assets ? &assets : NULL, progress))
+        return false;
+    if(progress != NULL && progress->cancelled.loadAcquire())
+        return false;
+    if(!writeFileAtomic(filename, buffer))
+        return false;
+
+    // the journal starts off empty at the end of the file
+    journal->filename = filename;
+    journal->start = buffer.size();
+    journal->end = buffer.size();
+    journal->embedded = embed_assets;
+    journal->assets = assets;
+    return true;
+}
 
-    // close the file when we are finished
-    fclose(to_write);
+// function that will write the buffer to the given file without ever leaving a half written file behind. the buffer
+// goes into a temporary file next to the real one, is flushed all the way to disk and then renamed over the top
+bool writeFileAtomic(const QString &filename, const QByteArray &buffer) {
+    // open up the temporary file for writing in binary mode
+    QByteArray real_filename = QFile::encodeName(filename);
+    QByteArray temp_filename = QFile::encodeName(filename + ".tmp");
+    FILE *to_write = fopen(temp_filename.constData(), "wb");
+    if(to_write == NULL)
+        return false;
+
+    // the temporary file takes the place of the real one so it gets the same permissions, otherwise every save
+    // would reset them to the defaults and could leave a private file readable by everyone
+    struct stat original;
+    bool success = true;
+    if(stat(real_filename.constData(), &original) == 0 && fchmod(fileno(to_write), original.st_mode & 07777) != 0)
+        success = false;
+
+    // write the buffer with a single call and make sure it has reached the disk before closing
+    size_t written = fwrite(buffer.constData(), sizeof(char), buffer.size(), to_write);
+    success = success && written == (size_t) buffer.size() && fflush(to_write) == 0 && fsync(fileno(to_write)) == 0;
+    if(fclose(to_write) != 0)
+        success = false;
+
+    // move the temporary file over the real one, getting rid of it if anything has gone wrong
+    if(!success || rename(temp_filename.constData(), real_filename.constData()) != 0) {
+        remove(temp_filename.constData());
+        return false;
+    }
+
+    // flush the directory as well so the rename itself survives a crash
+    int directory = open(QFile::encodeName(QFileInfo(filename).absolutePath()).constData(), O_RDONLY);
+    if(directory >= 0) {
+        fsync(directory);
+        close(directory);
+    }
+    return true;
 }
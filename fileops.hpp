@@ -6,10 +6,77 @@
 // describes operations that are necessary for reading and writing files to and from disk
 
 // includes
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QVector>
 #include "drawoperations.hpp"
 
+// structure used to parse a whiteboard straight out of memory. every read is checked against the size of the
+// data, once a read goes past the end the reader is marked as failed and every read after it fails too
+struct WhiteboardReader {
+    const uchar *data; // the start of the data being read
+    qint64 size; // how many bytes of data there are
+    qint64 position; // where the next read will come from
+    bool failed; // has a read gone past the end of the data
+};
+
+// structure describing where a board is in a versioned whiteboard file. these make up the directory that sits
+// after the header so that any board can be found without reading the ones before it
+struct BoardEntry {
+    quint64 offset; // where the board starts in the file
+    unsigned int size; // how many bytes the board takes up
+    unsigned int checksum; // the crc32c of the bytes of the board
+    unsigned int flags; // flags describing how the board is stored
+    QString title; // the title of the board
+    QByteArray thumbnail; // the thumbnail of the board from the previews of the file, which is empty if there isn't one
+};
+
+// structure describing the journal of the whiteboard file that was last loaded or saved, so that later saves
+// can append to it rather than rewrite the whole file
+struct JournalState {
+    QString filename; // the file the journal belongs to. this is empty if there is no journal to append to
+    qint64 start; // where the journal starts in the file, which is straight after the last board
+    qint64 end; // where the last complete batch of the journal ends
+    bool embedded; // are the images embedded in the file rather than stored as paths
+    QHash<QByteArray, unsigned int> assets; // the id of each image embedded in the file looked up by its hash
+};
+
+// structure used to follow the progress of a save or export running on another thread and to ask it to stop
+struct TaskProgress {
+    QAtomicInt done; // how many boards have been finished
+    QAtomicInt cancelled; // set to ask the task to stop as soon as it can
+    QAtomicInt failed; // how many boards couldn't be written
+};
+
 // function prototypes
 
+// function that will allocate the array of images for a whiteboard with the given number of images. every image
+// starts off as null
+DrawOperations **allocateWhiteboard(unsigned int total_images, unsigned int *image_max);
+
+// function that will append everything that has changed in the whiteboard since it was last saved to the journal
+// of the file it was saved to, using the marks of the given journal. this returns false if the journal could not
+// be written
+bool appendJournal(DrawOperations **whiteboard, unsigned int total_images, const QVector<JournalEvent> &events, unsigned int journal_index, JournalState *journal, TaskProgress *progress);
+
+// function that will go through the ops [start, end) of the given operations and give every image that doesn't
+// have an id in assets the next one. the images that were given an id are added to added in the order of their ids
+void collectAssets(DrawOp *operations, unsigned int start, unsigned int end, QHash<QByteArray, unsigned int> &assets, QVector<ImageAsset *> &added);
+
+// function that will compress the board at the end of the buffer starting from the given offset. true is returned
+// if compressing it made it smaller and it was replaced
+bool compressBoard(QByteArray &buffer, int offset, int compression_level);
+
+// function that will count how many point and line operations follow on from the current position, up to the
+// given limit
+unsigned int countPointRun(WhiteboardReader *reader, unsigned int limit);
+
+// function that will decompress a compressed board into the given buffer. this returns false if the board is
+// damaged or uses a codec we don't know about
+bool decompressBoard(const uchar *data, unsigned int size, QByteArray &board);
+
 // function that will determine what max images value was used for this total images
 unsigned int determineMaxImages(unsigned int total_images);
 
@@ -19,87 +86,199 @@ unsigned int determineMaxOps(unsigned int total_ops);
 // function that will determine and return a relative path given the location of the whiteboard, and the location of the image
 QString determineRelativePath(QString whiteboard_path, QString image_path);
 
-// function that will load a line end from disk
-void loadLineEnd(DrawOperations *image, unsigned int draw_operation, FILE *to_read);
+// function that will compress an image into the bytes of a preview for a whiteboard file
+QByteArray encodePreview(const QImage &image);
+
+// function that will return the name of the file the given board is exported to, with the given extension
+QString exportFilename(unsigned int index, const QString &extension);
+
+// function that will delete a whiteboard along with all of its images
+void freeWhiteboard(DrawOperations **ops, unsigned int max_images);
+
+// function that will tell us if the image has changed since it was last written to the file of the given journal
+bool hasBoardChanges(DrawOperations *board, unsigned int journal);
+
+// function that will tell us if anything in the whiteboard has changed since it was last written to the file of
+// the given journal
+bool hasJournalChanges(DrawOperations **whiteboard, unsigned int total_images, const QVector<JournalEvent> &events, unsigned int journal);
+
+// function that will tell us if the given draw operation is one of the point or line operations
+bool isPointOp(unsigned int draw_operation);
+
+// function that will look up the embedded image with the id that is next in the whiteboard data. this returns
+// null and marks the reader as failed if there is no such image or it isn't of the given type
+ImageAsset *loadAssetId(WhiteboardReader *reader, QVector<ImageAsset *> &assets, bool vector);
+
+// function that will read in the asset table of a whiteboard with embedded images and load each of the images.
+// each image is added to assets with a reference that the caller has to release. mapped images use their bytes
+// where they are in the data rather than copying them. this returns false if the table or any of the images are
+// damaged
+bool loadAssetTable(WhiteboardReader *reader, QString &filename, QVector<ImageAsset *> &assets, bool mapped);
+
+// function that will load a single board of a versioned whiteboard straight from its place in the data. the
+// images embedded in the file are looked up in assets. this returns null if the board is damaged
+DrawOperations *loadBoard(WhiteboardReader *reader, const BoardEntry &entry, QString &filename, QVector<ImageAsset *> &assets);
+
+// function that will read in the header and board directory of a versioned whiteboard, along with the thumbnail of
+// each board if the file has them. this returns false if the header or directory is malformed or the file is from
+// a newer version than we understand
+bool loadBoardDirectory(WhiteboardReader *reader, unsigned int *flags, QVector<BoardEntry> &directory);
 
-// function that will load a line point from disk
-void loadLinePoint(DrawOperations *image, unsigned int draw_operation, FILE *to_read);
+// function that will load every board in the directory at once on a thread pool. the boards are returned in the
+// order of the directory with any that are damaged left as null
+void loadBoards(WhiteboardReader *reader, const QVector<BoardEntry> &directory, QString &filename, QVector<ImageAsset *> &assets, QVector<DrawOperations *> &boards);
 
-// function that will load a line end from disk
-void loadLineStart(DrawOperations *image, unsigned int draw_operation, FILE *to_read);
+// function that will read in the section of previews that follows the header of a versioned whiteboard. the cover
+// is only read in if it is asked for. this returns false if the section is malformed
+bool loadPreviewSection(WhiteboardReader *reader, unsigned int total_images, QByteArray *cover, QVector<QByteArray> &thumbnails);
 
-// function that will load a point circle from disk
-void loadPointCircle(DrawOperations *image, unsigned int draw_operation, FILE *to_read);
+// function that will read the cover and the thumbnail of each board out of a whiteboard file without loading any
+// of the boards. only the start of the file is read. this returns false if the file has no previews
+bool loadPreviews(const QString &filename, QByteArray *cover, QVector<QByteArray> &thumbnails);
 
-// function that will load a point square from disk
-void loadPointSquare(DrawOperations *image, unsigned int draw_operation, FILE *to_read);
+// function that will load a QString from the whiteboard data and will return it
+QString loadQString(WhiteboardReader *reader);
 
-// function that will load an x point from disk
-void loadPointX(DrawOperations *image, unsigned int draw_operation, FILE *to_read);
+// function that will load a raster image from the whiteboard data. the image is either the id of one of the
+// given embedded images or, if there are none, the path to it
+void loadRasterImage(DrawOperations *image, unsigned int draw_operation, WhiteboardReader *reader, QString &filename, QVector<ImageAsset *> *assets);
 
-// function that will load a QString from disk and will return it
-QString loadQString(FILE *to_read);
+// function that will load an SVG image from the whiteboard data. the image is either the id of one of the given
+// embedded images or, if there are none, the path to it
+void loadSVGImage(DrawOperations *image, unsigned int draw_operation, WhiteboardReader *reader, QString &filename, QVector<ImageAsset *> *assets);
 
-// function that will load a raster image from disk
-void loadRasterImage(DrawOperations *image, unsigned int draw_operation, FILE *to_read, QString &filename);
+// function that will load a freehand line stored as a start point followed by the differences between each point.
+// at most max_points points are accepted and the number of points in the line is returned
+unsigned int loadStroke(DrawOperations *image, WhiteboardReader *reader, QVector<QPoint> &points, unsigned int max_points);
 
-// function that will load a straight line start from disk
-void loadStraightLineStart(DrawOperations *image, unsigned int draw_operation, FILE *to_read);
+// function that will load a text op from the whiteboard data
+void loadText(DrawOperations *image, unsigned int draw_operation, WhiteboardReader *reader);
 
-// function that will load a straight line end from disk
-void loadStraightLineEnd(DrawOperations *image, unsigned int draw_operation, FILE *to_read);
+// function that will load a whiteboard from disk, this takes in points to variables where the max images and total
+// images are stored along with the journal of the file and whether any of the boards were damaged and left empty.
+// this returns null if the file can't be read or is malformed
+DrawOperations **loadWhiteboard(QString &filename, unsigned int *image_total, unsigned int *image_max, JournalState *journal, bool *damaged);
 
-// function that will load an SVG image from disk
-void loadSVGImage(DrawOperations *image, unsigned int draw_operation, FILE *to_read, QString &filename);
+// function that will open the given file and point the reader at the whole of it, mapping it into memory if it
+// can. the data stays around until the file is closed or contents goes away. this returns false if the file can't
+// be opened
+bool mapWhiteboardFile(QFile &file, WhiteboardReader *reader, QByteArray &contents);
 
-// function that will load a text op from disk
-void loadText(DrawOperations *image, unsigned int draw_operation, FILE *to_read);
+// function that will parse a single board out of the given data. the flags say how the board was stored and the
+// images embedded in the file are looked up in assets. this returns null if the data is malformed
+DrawOperations *parseBoard(WhiteboardReader *reader, QString &filename, QVector<ImageAsset *> &assets, unsigned int flags);
 
-// function that will load a whiteboard from disk, this takes in points to variables where
-// the max images and total images are stored
-DrawOperations **loadWhiteboard(QString &filename, unsigned int *image_total, unsigned int *image_max);
+// function that will parse the given number of ops out of the data and add them onto the end of the board. the
+// images embedded in the file are looked up in assets. this returns false if the data is malformed
+bool parseOps(WhiteboardReader *reader, DrawOperations *board, unsigned int total_ops, QString &filename, QVector<ImageAsset *> &assets, unsigned int flags);
+
+// function that will parse a whiteboard in the original format out of the given data. this returns null if the
+// data is malformed
+DrawOperations **parseWhiteboardV1(WhiteboardReader *reader, QString &filename, unsigned int *image_total, unsigned int *image_max);
+
+// function that will parse a versioned whiteboard out of the given data along with its journal. damaged boards
+// are left empty and reported through damaged. this returns null if the data is malformed
+DrawOperations **parseWhiteboardV2(WhiteboardReader *reader, QString &filename, unsigned int *image_total, unsigned int *image_max, JournalState *journal, bool *damaged);
+
+// function that will start decoding every image used by the whiteboard on the global thread pool, so they
+// are ready by the time they are first drawn
+void queueAssetDecodes(DrawOperations **whiteboard, unsigned int total_images);
+
+// function that will read raw bytes out of the whiteboard data. if there are not enough bytes left the reader is
+// marked as failed, the destination is zeroed and false is returned
+bool readBytes(WhiteboardReader *reader, void *destination, qint64 length);
+
+// function that will return a pointer to the next length bytes of the whiteboard data and move past them
+const uchar *readSpan(WhiteboardReader *reader, qint64 length);
+
+// function that will read an unsigned int out of the whiteboard data. this returns zero if the read fails
+unsigned int readUInt(WhiteboardReader *reader);
+
+// function that will read a varint out of the whiteboard data. this returns zero if the read fails
+unsigned int readVarint(WhiteboardReader *reader);
 
 // function that will recreate an absolute path from the current file location and a relative path
 QString recreateAbsolutePath(QString whiteboard_path, QString relative_path);
 
-// function that will write a line end to disk
-void saveLineEnd(DrawOp *point, FILE *to_write);
-
-// function that will write a line start to disk
-void saveLineStart(DrawOp *point, FILE *to_write);
+// function that will replace every board that couldn't be loaded with an empty one holding the title from its
+// directory entry. this returns true if any of the boards were replaced
+bool replaceDamagedBoards(const QVector<BoardEntry> &directory, QVector<DrawOperations *> &boards);
 
-// function that will write a line point to disk
-void saveLinePoint(DrawOp *point, FILE *to_write);
+// function that will apply the journal that starts at the current position of the reader to the boards, stopping
+// at the first missing or damaged batch. embedded images are looked up in and added to assets, which is null if the
+// file doesn't embed its images. this returns false if an undamaged batch doesn't make sense for the boards
+bool replayJournal(WhiteboardReader *reader, QVector<DrawOperations *> &boards, QString &filename, QVector<ImageAsset *> *assets, qint64 *journal_end);
 
-// function that will write the given point circle to disk
-void savePointCircle(DrawOp *point, FILE *to_write);
+// function that will apply a single batch of the journal to the boards. embedded images are looked up in and added
+// to assets, which is null if the file doesn't embed its images. this returns false if any of the records in the
+// batch don't make sense for the boards
+bool replayJournalBatch(WhiteboardReader *reader, QVector<DrawOperations *> &boards, QString &filename, QVector<ImageAsset *> *assets);
 
-// function that will write the given point circle to disk
-void savePointSquare(DrawOp *point, FILE *to_write);
+// function that will append the raw bytes of a value to the end of the buffer
+void saveBytes(const void *data, unsigned int length, QByteArray &buffer);
 
-// function that will write the given point x to disk
-void savePointX(DrawOp *point, FILE *to_write);
+// function that will write a run of point and line operations into the buffer
+void savePointRun(DrawOp *run, unsigned int count, QByteArray &buffer);
 
-// function that will take a qstring and will write it to disk
+// function that will take a qstring and will write it into the buffer
 // it will do so by figuring out its length, write that first and then write the byte array
-void saveQString(QString *string, FILE *to_write);
+void saveQString(QString *string, QByteArray &buffer);
+
+// function that will write a raster image operation into the buffer. if assets is given the image is written as
+// its id in the file, otherwise as the path to it
+void saveRasterImage(DrawOp *raster, QByteArray &buffer, QString &filename, const QHash<QByteArray, unsigned int> *assets);
+
+// function that will write an SVG image into the buffer. if assets is given the image is written as its id in the
+// file, otherwise as the path to it
+void saveSVGImage(DrawOp *svg, QByteArray &buffer, QString &filename, const QHash<QByteArray, unsigned int> *assets);
+
+// function that will write a freehand line into the buffer as a stroke
+void saveStroke(DrawOp *operations, unsigned int count, QByteArray &buffer);
+
+// function that will write a text operation into the buffer
+void saveText(DrawOp *text, QByteArray &buffer);
+
+// function that will write an unsigned value into the buffer as a varint
+void saveVarint(unsigned int value, QByteArray &buffer);
+
+// function that will take a whiteboard and write it to disk, compressing each board at the given level. zero means
+// the boards are left uncompressed. the images are embedded in the file if embed_assets is true. the cover and the
+// up to date thumbnails of the boards are written as the previews of the file. where the empty journal of the file
+// starts is returned through journal. this returns false if the file could not be written or the save was
+// cancelled through progress, which may be null
+bool saveWhiteboard(QString &filename, DrawOperations **whiteboard, unsigned int total_images, int compression_level, bool embed_assets, const QByteArray &cover, JournalState *journal, TaskProgress *progress);
+
+// function that will serialise the asset table for the given images onto the end of the buffer, followed by the
+// bytes of each of the images
+void serialiseAssetTable(QString &filename, const QVector<ImageAsset *> &assets, QByteArray &buffer);
+
+// function that will serialise a single board onto the end of the buffer. images are written as their id in
+// assets if it is given
+void serialiseBoard(QString &filename, DrawOperations *board, const QHash<QByteArray, unsigned int> *assets, QByteArray &buffer);
 
-// function that will write a raster image operation to disk
-void saveRasterImage(DrawOp *raster, FILE *to_write, QString &filename);
+// function that will serialise everything that has changed in the whiteboard since it was last saved into a
+// single batch of the journal. new images are added to assets if the file embeds its images. nothing is written if
+// nothing has changed
+void serialiseJournal(QString &filename, DrawOperations **whiteboard, unsigned int total_images, const QVector<JournalEvent> &events, unsigned int journal, QHash<QByteArray, unsigned int> *assets, QByteArray &buffer);
 
-// function that will write the straight line start to disk
-void saveStraightLineStart(DrawOp *point, FILE *to_write);
+// function that will serialise the ops [start, end) of the given operations onto the end of the buffer. images are
+// written as their id in assets if it is given
+void serialiseOps(QString &filename, DrawOp *operations, unsigned int start, unsigned int end, const QHash<QByteArray, unsigned int> *assets, QByteArray &buffer);
 
-// function that will write the straight line end to disk
-void saveStraightLineEnd(DrawOp *point, FILE *to_write);
+// function that will serialise a whole whiteboard into the buffer. the header, the previews and a directory of
+// every board come first, followed by the embedded images if assets is given and then each of the boards. each
+// board is compressed at the given level. this returns false if it was cancelled through progress, which may be null
+bool serialiseWhiteboard(QString &filename, DrawOperations **whiteboard, unsigned int total_images, QByteArray &buffer, int compression_level, const QByteArray &cover, QHash<QByteArray, unsigned int> *assets, TaskProgress *progress);
 
-// function that will write an SVG image to disk
-void saveSVGImage(DrawOp *svg, FILE *to_write, QString &filename);
+// function that will take a snapshot of the whiteboard that shares the draw operations of every image. the
+// snapshot can be read on another thread while the whiteboard carries on being changed
+DrawOperations **snapshotWhiteboard(DrawOperations **whiteboard, unsigned int total_images);
 
-// function that will write a text operation to disk
-void saveText(DrawOp *text, FILE *to_write);
+// function that will work out how many ops from the given position make up a freehand line that can be written as a
+// stroke. zero is returned if the ops can't be written as a stroke
+unsigned int strokeLength(DrawOp *operations, unsigned int position, unsigned int total_ops);
 
-// function that will take a whiteboard and write it to disk
-void saveWhiteboard(QString &filename, DrawOperations **whiteboard, unsigned int total_images);
+// function that will write the buffer to the given file without ever leaving a half written file behind
+bool writeFileAtomic(const QString &filename, const QByteArray &buffer);
 
 #endif // _FILEOPS_H
@@ -0,0 +1,88 @@
+// headlessexport.cpp
+//
+// implements everything described in headlessexport.hpp
+
+// includes
+#include <iostream>
+#include <QDir>
+#include <QFileInfo>
+#include <QThreadPool>
+#include "backgroundtasks.hpp"
+#include "constants.hpp"
+#include "fileops.hpp"
+#include "headlessexport.hpp"
+
+// functions
+
+// function that will export every board of the given whiteboard file in the given format. png images are drawn at
+// the given scale into the given directory along with svg documents, and a pdf is written to the given file with a
+// page for each board. the boards are drawn and written on a pool of threads the same way the export buttons do it,
+// so no whiteboard is needed. this returns the exit code of the application, which is zero if every board was
+// exported
+int exportWhiteboardFile(const QString &filename, const QString &out, const QString &format, qreal scale) {
+    // make sure we have been asked for something we can do
+    bool pdf = format == QString("pdf");
+    bool svg = format == QString("svg");
+    if(format != QString("png") && !pdf && !svg) {
+        std::cerr << "Unsupported export format " << format.toStdString() << ", only png, pdf and svg are supported" << std::endl;
+        return 1;
+    }
+    if(scale <= 0 || scale > EXPORT_MAX_SCALE) {
+        std::cerr << "The export scale has to be more than 0 and at most " << EXPORT_MAX_SCALE << std::endl;
+        return 1;
+    }
+    QString directory = pdf ? QFileInfo(out).absolutePath() : out;
+    if(!QDir().mkpath(directory)) {
+        std::cerr << "Could not create the export directory " << directory.toStdString() << std::endl;
+        return 1;
+    }
+
+    // read in the whole whiteboard. the images of the whiteboard are found relative to the absolute path of the file
+    QString load_filename = QFileInfo(filename).absoluteFilePath();
+    unsigned int total_images = 0;
+    unsigned int max_images = 0;
+    JournalState journal;
+    bool damaged = false;
+    DrawOperations **board = loadWhiteboard(load_filename, &total_images, &max_images, &journal, &damaged);
+    if(board == NULL) {
+        std::cerr << "Could not load the whiteboard from " << filename.toStdString() << ". The file is either unreadable or damaged" << std::endl;
+        return 1;
+    }
+    if(damaged)
+        std::cerr << "Some of the images in " << filename.toStdString() << " were damaged and have been left empty" << std::endl;
+
+    // draw and write every board. images are drawn on as many threads as the memory budget allows at this scale
+    // and svg documents on every core, while the pages of a pdf all go into the one file so are drawn one after the
+    // other
+    TaskProgress progress;
+    progress.done.storeRelease(0);
+    progress.cancelled.storeRelease(0);
+    progress.failed.storeRelease(0);
+    QThreadPool pool;
+    if(pdf) {
+        pool.setMaxThreadCount(1);
+        pool.start(new PDFExportTask(board, total_images, out, &progress));
+    } else if(svg) {
+        for(unsigned int i = 0; i < total_images; i++)
+            pool.start(new SVGExportTask(board[i], i, total_images, out + exportFilename(i, format), &progress));
+    } else {
+        pool.setMaxThreadCount(exportThreadCount(scale));
+        for(unsigned int i = 0; i < total_images; i++)
+            pool.start(new BoardExportTask(board[i], i, total_images, scale, out + exportFilename(i, format), &progress));
+    }
+    pool.waitForDone();
+    freeWhiteboard(board, max_images);
+
+    // let the user know how it went
+    unsigned int failed = progress.failed.loadAcquire();
+    if(pdf && failed > 0) {
+        std::cerr << "Could not write the pdf " << out.toStdString() << std::endl;
+        return 1;
+    }
+    if(failed > 0) {
+        std::cerr << "Could not write " << failed << " of the " << total_images << " images to " << out.toStdString() << std::endl;
+        return 1;
+    }
+    std::cout << "Exported " << total_images << " images to " << out.toStdString() << std::endl;
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef _HEADLESSEXPORT_HPP
+#define _HEADLESSEXPORT_HPP
+
+// headlessexport.hpp
+//
+// describes exporting a whiteboard file straight from the command line without putting a window up, so that files
+// can be converted in bulk on machines without a display
+
+// includes
+#include <QString>
+
+// function prototypes
+
+// function that will export every board of the given whiteboard file in the given format. png images are drawn at
+// the given scale into the directory given by out, as are svg documents, while a pdf is written to the file given by
+// out. progress and any problems are written to the console. this returns the exit code of the application, which is
+// zero if every board was exported
+int exportWhiteboardFile(const QString &filename, const QString &out, const QString &format, qreal scale);
+
+#endif // _HEADLESSEXPORT_HPP
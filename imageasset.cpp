@@ -0,0 +1,214 @@
+// imageasset.cpp
+//
+// implements everything described in imageasset.hpp
+
+// includes
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include "imageasset.hpp"
+
+// the images that are currently loaded in, looked up by their filename and by the hash of their contents. these
+// are guarded by the mutex as boards may be loaded and released from worker threads
+static QHash<QString, ImageAsset *> raster_assets;
+static QHash<QString, ImageAsset *> svg_assets;
+static QHash<QByteArray, ImageAsset *> content_assets;
+static QMutex assets_mutex;
+
+// functions
+
+// function that will decode the svg image. the renderer is a QObject that belongs to the thread that makes it, so
+// when it is made on a worker thread it is handed over to the gui thread, which is where it is deleted and where
+// the timer of an animated image needs an event loop. the decode mutex must be held
+static void decodeSVG(ImageAsset *asset) {
+    asset->svg = new QSvgRenderer(asset->data);
+    if(QCoreApplication::instance() != NULL)
+        asset->svg->moveToThread(QCoreApplication::instance()->thread());
+}
+
+// function that will get rid of a decoded svg image. the renderer belongs to the gui thread so it is deleted straight
+// away there, while from any other thread it is left for the gui thread to delete along with its animation timer
+static void deleteSVG(QSvgRenderer *svg) {
+    if(svg == NULL)
+        return;
+    if(svg->thread() == QThread::currentThread())
+        delete svg;
+    else
+        svg->deleteLater();
+}
+
+// function that will make a new image from the given bytes and remember it by its contents. the mutex must be held
+static ImageAsset *createAsset(const QString &filename, const QByteArray &data, const QByteArray &hash, bool vector) {
+    ImageAsset *asset = new ImageAsset();
+    asset->filename = filename;
+    asset->data = data;
+    asset->hash = hash;
+    asset->vector = vector;
+    asset->raster = NULL;
+    asset->svg = NULL;
+    asset->ref_count.storeRelease(1);
+    if(!content_assets.contains(hash))
+        content_assets.insert(hash, asset);
+    return asset;
+}
+
+// function that will return the image for the given file, reading the file in if no other operation is using it
+// already. files that hold the same bytes as an image that is already loaded share that image
+static ImageAsset *acquireFileAsset(QHash<QString, ImageAsset *> &assets, const QString &filename, bool vector) {
+    // if the file is already loaded then just take another reference to it
+    QMutexLocker locker(&assets_mutex);
+    ImageAsset *asset = assets.value(filename, NULL);
+    if(asset != NULL) {
+        asset->ref_count.ref();
+        return asset;
+    }
+
+    // read in the file without holding on to the mutex so that boards being loaded on other threads aren't held up.
+    // a file that can't be read leaves the image empty, the same as one that can't be decoded
+    locker.unlock();
+    QByteArray data;
+    QFile file(filename);
+    if(file.open(QIODevice::ReadOnly))
+        data = file.readAll();
+    QByteArray hash = hashAssetData(data);
+    locker.relock();
+
+    // another thread may have loaded the same file while we were reading it
+    asset = assets.value(filename, NULL);
+    if(asset != NULL) {
+        asset->ref_count.ref();
+        return asset;
+    }
+
+    // share an image with the same contents if there is one, otherwise make a new one. either way remember it for
+    // anyone else that wants this file
+    asset = content_assets.value(hash, NULL);
+    if(asset != NULL && asset->vector == vector)
+        asset->ref_count.ref();
+    else
+        asset = createAsset(filename, data, hash, vector);
+    assets.insert(filename, asset);
+    asset->aliases.append(filename);
+    return asset;
+}
+
+// function that will return the raster image for the given file. the file is only read from disk if no other
+// operation is using it already
+ImageAsset *acquireRasterAsset(const QString &filename) {
+    return acquireFileAsset(raster_assets, filename, false);
+}
+
+// function that will return the svg image for the given file. the file is only read from disk if no other
+// operation is using it already
+ImageAsset *acquireSVGAsset(const QString &filename) {
+    return acquireFileAsset(svg_assets, filename, true);
+}
+
+// function that will return the image with the given bytes and hash, which have been embedded in a whiteboard
+// file. the bytes are only copied if no other operation is using an image with the same contents already
+ImageAsset *acquireEmbeddedAsset(const QString &filename, const uchar *data, qint64 size, const QByteArray &hash, bool vector) {
+    QMutexLocker locker(&assets_mutex);
+
+    // if an image with the same contents is already loaded then just take another reference to it
+    ImageAsset *asset = content_assets.value(hash, NULL);
+    if(asset != NULL && asset->vector == vector) {
+        asset->ref_count.ref();
+        return asset;
+    }
+
+    // take a copy of the bytes as the data they are in goes away once the whiteboard has been loaded. the image
+    // isn't remembered by its filename as the file may no longer hold the same bytes
+    return createAsset(filename, QByteArray((const char *) data, (int) size), hash, vector);
+}
+
+// function that will return the image with the given bytes and hash, which sit in a whiteboard file mapped into
+// memory. the bytes are used where they are so nothing is read in until the image is first drawn
+ImageAsset *acquireMappedAsset(const QString &filename, const uchar *data, qint64 size, const QByteArray &hash, bool vector) {
+    // the image isn't remembered anywhere as other operations mustn't pick it up and outlive the mapping
+    ImageAsset *asset = new ImageAsset();
+    asset->filename = filename;
+    asset->data = QByteArray::fromRawData((const char *) data, (int) size);
+    asset->hash = hash;
+    asset->vector = vector;
+    asset->raster = NULL;
+    asset->svg = NULL;
+    asset->ref_count.storeRelease(1);
+    return asset;
+}
+
+// function that will return the decoded raster image, decoding it if this is the first time it is needed. images
+// are decoded under their own mutex so decoding one doesn't hold up any of the others
+QImage *assetRaster(ImageAsset *asset) {
+    QMutexLocker locker(&asset->decode_mutex);
+    if(asset->raster == NULL)
+        asset->raster = new QImage(QImage::fromData(asset->data));
+    return asset->raster;
+}
+
+// function that will return the decoded svg image, decoding it if this is the first time it is needed
+QSvgRenderer *assetSVG(ImageAsset *asset) {
+    QMutexLocker locker(&asset->decode_mutex);
+    if(asset->svg == NULL)
+        decodeSVG(asset);
+    return asset->svg;
+}
+
+// function that will return the sha1 hash of the given bytes
+QByteArray hashAssetData(const QByteArray &data) {
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+// function that will drop a reference to an image and delete it if nothing is using it anymore
+void releaseImageAsset(ImageAsset *asset) {
+    // nothing to do for an empty reference
+    if(asset == NULL)
+        return;
+
+    // drop the reference, if there are still users of the image then we are done
+    QMutexLocker locker(&assets_mutex);
+    if(asset->ref_count.deref())
+        return;
+
+    // nothing is using the image anymore so forget about it wherever it was remembered and delete it
+    QHash<QString, ImageAsset *> &assets = asset->vector ? svg_assets : raster_assets;
+    for(int i = 0; i < asset->aliases.size(); i++) {
+        if(assets.value(asset->aliases[i], NULL) == asset)
+            assets.remove(asset->aliases[i]);
+    }
+    if(content_assets.value(asset->hash, NULL) == asset)
+        content_assets.remove(asset->hash);
+    delete asset->raster;
+    deleteSVG(asset->svg);
+    delete asset;
+}
+
+// function that will draw the svg image into the given bounds. the image is drawn under its mutex as well so boards
+// being exported on other threads can share it with the whiteboard
+void renderAssetSVG(ImageAsset *asset, QPainter *painter, const QRectF &bounds) {
+    QMutexLocker locker(&asset->decode_mutex);
+    if(asset->svg == NULL)
+        decodeSVG(asset);
+    asset->svg->render(painter, bounds);
+}
+
+// function that will take an extra reference to an image that is already in use
+void retainImageAsset(ImageAsset *asset) {
+    // the caller already holds a reference so the image can't be deleted underneath us
+    if(asset != NULL)
+        asset->ref_count.ref();
+}
+
+// function that will throw away the decoded image if nothing but the caller is using it
+void trimImageAsset(ImageAsset *asset) {
+    QMutexLocker locker(&asset->decode_mutex);
+    if(asset->ref_count.loadAcquire() != 1)
+        return;
+    delete asset->raster;
+    deleteSVG(asset->svg);
+    asset->raster = NULL;
+    asset->svg = NULL;
+}
@@ -0,0 +1,79 @@
+#ifndef _IMAGEASSET_HPP
+#define _IMAGEASSET_HPP
+
+// imageasset.hpp
+//
+// describes the images that the raster and svg draw operations place on a whiteboard. each file is only loaded
+// in once and is then shared between every operation that uses it, including the operations of duplicated
+// boards. images are reference counted and are deleted when the last operation using them goes away. the bytes
+// of the file are kept along with a hash of them so that the image can be embedded in a saved whiteboard, and
+// the image itself is only decoded from them the first time it is drawn
+
+// includes
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QImage>
+#include <QMutex>
+#include <QPainter>
+#include <QRectF>
+#include <QString>
+#include <QStringList>
+#include <QtSvg>
+
+// structure holding an image that has been loaded in for a draw operation
+struct ImageAsset {
+    QString filename; // the name of the file that the image is loaded from
+    QStringList aliases; // every filename the image is remembered by, so those are all it has to be forgotten by
+    QByteArray data; // the bytes of the file the image is decoded from
+    QByteArray hash; // the sha1 hash of the bytes, used to find images with the same contents
+    bool vector; // true for svg images and false for raster images
+    QImage *raster; // the decoded raster image. this is null until the image is first drawn and for svg images
+    QSvgRenderer *svg; // the decoded svg image. this is null until the image is first drawn and for raster images
+    QMutex decode_mutex; // guards the decoding of the image so it is only decoded once
+    QAtomicInt ref_count; // how many draw operations are using this image
+};
+
+// function prototypes
+
+// function that will return the raster image for the given file. the file is only read from disk if no other
+// operation is using it already
+ImageAsset *acquireRasterAsset(const QString &filename);
+
+// function that will return the svg image for the given file. the file is only read from disk if no other
+// operation is using it already
+ImageAsset *acquireSVGAsset(const QString &filename);
+
+// function that will return the image with the given bytes and hash, which have been embedded in a whiteboard
+// file. the bytes are only copied if no other operation is using an image with the same contents already
+ImageAsset *acquireEmbeddedAsset(const QString &filename, const uchar *data, qint64 size, const QByteArray &hash, bool vector);
+
+// function that will return the image with the given bytes and hash, which sit in a whiteboard file mapped into
+// memory. the bytes aren't copied so the image must go before the mapping does, and it isn't shared with anything
+// else for the same reason
+ImageAsset *acquireMappedAsset(const QString &filename, const uchar *data, qint64 size, const QByteArray &hash, bool vector);
+
+// function that will return the decoded raster image, decoding it if this is the first time it is needed
+QImage *assetRaster(ImageAsset *asset);
+
+// function that will return the decoded svg image, decoding it if this is the first time it is needed. the
+// renderer always belongs to the gui thread, whichever thread it was decoded on
+QSvgRenderer *assetSVG(ImageAsset *asset);
+
+// function that will return the sha1 hash of the given bytes
+QByteArray hashAssetData(const QByteArray &data);
+
+// function that will drop a reference to an image and delete it if nothing is using it anymore
+void releaseImageAsset(ImageAsset *asset);
+
+// function that will draw the svg image into the given bounds, decoding it if this is the first time it is needed.
+// an svg renderer can't be drawn from on two threads at once so this is what should be used to draw it
+void renderAssetSVG(ImageAsset *asset, QPainter *painter, const QRectF &bounds);
+
+// function that will take an extra reference to an image that is already in use
+void retainImageAsset(ImageAsset *asset);
+
+// function that will throw away the decoded image if nothing but the caller is using it. it is decoded again the
+// next time it is needed. this must be called on the gui thread
+void trimImageAsset(ImageAsset *asset);
+
+#endif // _IMAGEASSET_HPP
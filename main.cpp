@@ -5,18 +5,103 @@
 // saving and dumping of images to file using PNG format.
 
 // includes
+#include <cstring>
 #include <iostream>
 #include <QApplication>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QStringList>
+#include "constants.hpp"
+#include "headlessexport.hpp"
 #include "mainwindow.hpp"
 
 // entry point to our program
 int main(int argc, char** argv) {
+    // start timing the startup so we can log how long it takes to get something on screen
+    QElapsedTimer startup_timer;
+    startup_timer.start();
+
+    // exporting from the command line doesn't put a window up, so it is drawn on the offscreen platform to work on
+    // machines without a display. the platform has to be picked before the application is made so the arguments
+    // are looked through by hand. a platform that has been asked for explicitly is left alone
+    for(int i = 1; i < argc; i++) {
+        if((strcmp(argv[i], "--export") == 0 || strncmp(argv[i], "--export=", 9) == 0) && qgetenv("QT_QPA_PLATFORM").isEmpty())
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
     // create a QApplication that will manage everything for the QT toolkit
     QApplication app(argc, argv);
 
+    // name the application so that its settings and recovery file have somewhere to go
+    QApplication::setOrganizationName("qt_whiteboard");
+    QApplication::setApplicationName("qt_whiteboard");
+
+    // a whiteboard file can be given on the command line to open it straight away. the path is made absolute as
+    // the images of the whiteboard are found relative to it. the viewer opens whiteboards read only
+    QCommandLineParser parser;
+    parser.setApplicationDescription("A whiteboard that can be drawn on");
+    parser.addHelpOption();
+    parser.addPositionalArgument("file", "The whiteboard file to open.", "[file]");
+    QCommandLineOption view_option("view", "Open whiteboards read only, only loading each one when it is viewed.");
+    parser.addOption(view_option);
+
+    // a whiteboard file can also be exported without putting a window up
+    QCommandLineOption export_option("export", "Export every image of the whiteboard file without opening a window.", "file");
+    QCommandLineOption out_option("out", "The directory the images are exported to, or the file for a pdf.", "path");
+    QCommandLineOption format_option("format", "The format the images are exported in, png, pdf or svg, png by default.", "format", "png");
+    QCommandLineOption scale_option("scale", "How many times 1920x1080 png images are exported at, 1 by default.", "scale", "1");
+    QCommandLineOption resolution_option("resolution", "The resolution png images are exported at, one of 1080p, 1440p, 4K or 8K.", "resolution");
+    QCommandLineOption dpi_option("dpi", "The dpi png images are exported at, where 96 dpi is 1920x1080.", "dpi");
+    parser.addOption(export_option);
+    parser.addOption(out_option);
+    parser.addOption(format_option);
+    parser.addOption(scale_option);
+    parser.addOption(resolution_option);
+    parser.addOption(dpi_option);
+    parser.process(app);
+
+    // run the export and leave without ever creating the window
+    if(parser.isSet(export_option)) {
+        // the size to export at can be given as a scale, a named resolution or a dpi but only one of them. pdf and
+        // svg exports are drawn at a fixed size so they can't be given one at all
+        int sizes_set = (int) parser.isSet(scale_option) + (int) parser.isSet(resolution_option) + (int) parser.isSet(dpi_option);
+        QString format = parser.value(format_option).toLower();
+        if(sizes_set > 0 && format != QString("png")) {
+            std::cerr << "Only png images can be exported at a size given with --scale, --dpi or --resolution" << std::endl;
+            return 1;
+        }
+        bool scale_valid = sizes_set <= 1;
+        bool value_valid = false;
+        qreal scale = 1;
+        if(parser.isSet(resolution_option)) {
+            for(unsigned int i = 0; i < TOTAL_EXPORT_RESOLUTIONS; i++) {
+                if(parser.value(resolution_option).compare(QString(EXPORT_RESOLUTION_NAMES[i]), Qt::CaseInsensitive) == 0) {
+                    scale = EXPORT_RESOLUTION_SCALES[i];
+                    value_valid = true;
+                }
+            }
+        } else if(parser.isSet(dpi_option)) {
+            scale = parser.value(dpi_option).toDouble(&value_valid) / EXPORT_BASE_DPI;
+        } else {
+            scale = parser.value(scale_option).toDouble(&value_valid);
+        }
+        if(!parser.isSet(out_option) || !scale_valid || !value_valid) {
+            std::cerr << "Exporting needs a directory to export to given with --out and at most one of a number for --scale, a number for --dpi "
+                "or one of 1080p, 1440p, 4K or 8K for --resolution" << std::endl;
+            return 1;
+        }
+        return exportWhiteboardFile(parser.value(export_option), parser.value(out_option), format, scale);
+    }
+    QStringList arguments = parser.positionalArguments();
+    QString startup_filename("");
+    if(!arguments.isEmpty())
+        startup_filename = QFileInfo(arguments.first()).absoluteFilePath();
+
     // create a whiteboard and show it
     //Whiteboard board;
-    MainWindow board;
+    MainWindow board(startup_timer, startup_filename, parser.isSet(view_option));
     //board.showFullScreen();
     board.showMaximized();
 
@@ -6,17 +6,32 @@
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <QApplication>
 #include <QByteArray>
+#include <QCheckBox>
+#include <QComboBox>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QFileDialog>
+#include <QInputDialog>
+#include <QGridLayout>
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QLineEdit>
 #include <QMessageBox>
 #include <QPalette>
+#include <QPixmap>
+#include <QProgressBar>
 #include <QPushButton>
+#include <QSettings>
 #include <QSizePolicy>
+#include <QSlider>
 #include <QSpinBox>
+#include <QStandardPaths>
 #include <QString>
+#include <QThreadPool>
+#include <QTimer>
 #include <QVBoxLayout>
 #include "constants.hpp"
 #include "colourselector.hpp"
@@ -25,13 +40,70 @@
 #include "toolselector.hpp"
 
 // constructor for the class
-MainWindow::MainWindow(QWidget *parent)
-: QWidget(parent), filename(""), image_filename(""), load_raster(true)
+MainWindow::MainWindow(const QElapsedTimer &startup_timer, const QString &startup_filename, bool viewer, QWidget *parent)
+: QWidget(parent), filename(""), startup_timer(startup_timer), startup_filename(startup_filename), viewer(viewer), image_filename(""), load_raster(true)
 {
+    // start reading in the file given on the command line straight away so it is loaded while the widgets are set
+    // up, and load the image plugins in the background at the same time. the file is put on screen once the window
+    // is up
+    startup_loader = NULL;
+    startup_opened = false;
+    first_painted = false;
+    open_pool = new QThreadPool(this);
+    open_pool->setMaxThreadCount(1);
+    if(!startup_filename.isEmpty()) {
+        startup_loader = new BoardLoader(startup_filename, viewer, this);
+        open_pool->start(new WhiteboardOpenTask(startup_loader, &open_journal, &startup_opened));
+    }
+    QThreadPool::globalInstance()->start(new PluginWarmTask());
+
     // allocate space for our tools and selectors
     tools = new ToolSelector *[8];
     colours = new ColourSelector *[14];
 
+    // there is no saved file yet so there is no journal to add to
+    journal.filename = QString("");
+    journal.start = 0;
+    journal.end = 0;
+    journal.embedded = false;
+
+    // no boards are being loaded in yet and the open dialog isn't up
+    board_loader = NULL;
+    boards_loading = 0;
+    boards_damaged = false;
+    open_preview_label = NULL;
+
+    // nothing is being saved or exported yet. exported boards are drawn and written on a pool of their own threads
+    save_thread = NULL;
+    export_pool = new QThreadPool(this);
+    export_progress.done.storeRelease(0);
+    export_progress.cancelled.storeRelease(0);
+    export_progress.failed.storeRelease(0);
+    export_snapshot = NULL;
+    export_total = 0;
+    exporting = false;
+    task_timer = new QTimer(this);
+    task_timer->setInterval(TASK_TIMER_INTERVAL);
+    QObject::connect(task_timer, SIGNAL(timeout()), this, SLOT(updateTasks()));
+
+    // the whiteboard is autosaved to a recovery file in the cache directory. only what has changed is written each
+    // time, on its own thread, so the gui thread only has to take a snapshot
+    QString cache_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QDir().mkpath(cache_directory);
+    recovery_filename = cache_directory + "/" + AUTOSAVE_FILENAME;
+    autosave_journal.filename = QString("");
+    autosave_journal.start = 0;
+    autosave_journal.end = 0;
+    autosave_journal.embedded = false;
+    autosave_thread = NULL;
+    autosave_discarded = false;
+    autosave_timer = new QTimer(this);
+    QObject::connect(autosave_timer, SIGNAL(timeout()), this, SLOT(autosaveWhiteboard()));
+    QSettings settings;
+    int autosave_interval = settings.value("autosave/interval", AUTOSAVE_DEFAULT_INTERVAL).toInt();
+    if(autosave_interval > 0 && !viewer)
+        autosave_timer->start(autosave_interval * 1000);
+
     // create a vbox layout for this widget
     QVBoxLayout *whiteboard_container_layout = new QVBoxLayout();
     this->setLayout(whiteboard_container_layout);
@@ -59,10 +131,43 @@ MainWindow::MainWindow(QWidget *parent)
     save_button->setEnabled(false);
     QObject::connect(save_button, SIGNAL(clicked()), this, SLOT(saveImages()));
 
-    // add in an export to PNG button
+    // add in a checkbox for compressing the whiteboard when it is saved
+    compress_checkbox = new QCheckBox("Compress");
+    main_toolbar_layout->addWidget(compress_checkbox);
+
+    // add in a checkbox for embedding the images in the whiteboard file so it can be moved without breaking them
+    embed_checkbox = new QCheckBox("Embed Images");
+    main_toolbar_layout->addWidget(embed_checkbox);
+
+    // add in a progress bar and a cancel button for saves and exports. these are only shown while one is running
+    task_progress_bar = new QProgressBar();
+    task_progress_bar->setVisible(false);
+    main_toolbar_layout->addWidget(task_progress_bar);
+    cancel_button = new QPushButton("Cancel");
+    cancel_button->setVisible(false);
+    main_toolbar_layout->addWidget(cancel_button);
+    QObject::connect(cancel_button, SIGNAL(clicked()), this, SLOT(cancelTasks()));
+
+    // add in an export to PNG button along with the resolution to export at. the dpi is asked for when exporting
+    // if a custom one is picked
     QPushButton *export_png_button = new QPushButton("Export PNG");
     main_toolbar_layout->addWidget(export_png_button);
     QObject::connect(export_png_button, SIGNAL(clicked()), this, SLOT(exportPNG()));
+    export_resolution_combobox = new QComboBox();
+    for(unsigned int i = 0; i < TOTAL_EXPORT_RESOLUTIONS; i++)
+        export_resolution_combobox->addItem(QString(EXPORT_RESOLUTION_NAMES[i]));
+    export_resolution_combobox->addItem(QString("Custom DPI"));
+    main_toolbar_layout->addWidget(export_resolution_combobox);
+
+    // add in an export to PDF button. the pages are kept as shapes and text so they need no resolution
+    QPushButton *export_pdf_button = new QPushButton("Export PDF");
+    main_toolbar_layout->addWidget(export_pdf_button);
+    QObject::connect(export_pdf_button, SIGNAL(clicked()), this, SLOT(exportPDF()));
+
+    // add in an export to SVG button. like a PDF these are kept as shapes and text
+    QPushButton *export_svg_button = new QPushButton("Export SVG");
+    main_toolbar_layout->addWidget(export_svg_button);
+    QObject::connect(export_svg_button, SIGNAL(clicked()), this, SLOT(exportSVG()));
 
     // add in a button to lock and unlock the undo for the current image
     lock_button = new QPushButton("Lock");
@@ -74,6 +179,11 @@ MainWindow::MainWindow(QWidget *parent)
     main_toolbar_layout->addWidget(add_button);
     QObject::connect(add_button, SIGNAL(clicked()), this, SLOT(addNewImage()));
 
+    // add in a button for duplicating an image
+    QPushButton *duplicate_button = new QPushButton("Duplicate image");
+    main_toolbar_layout->addWidget(duplicate_button);
+    QObject::connect(duplicate_button, SIGNAL(clicked()), this, SLOT(duplicateImage()));
+
     // add in a button for deleting an image
     QPushButton *delete_button = new QPushButton("Delete image");
     main_toolbar_layout->addWidget(delete_button);
@@ -103,6 +213,13 @@ MainWindow::MainWindow(QWidget *parent)
     main_toolbar_layout->addWidget(image_title_edit);
     QObject::connect(image_title_edit, SIGNAL(textEdited(const QString &)), this, SLOT(titleChanged(const QString &)));
 
+    // add in a label and a slider for scrubbing the current image through its history
+    QLabel *history_label = new QLabel("History:");
+    main_toolbar_layout->addWidget(history_label);
+    history_slider = new QSlider(Qt::Horizontal);
+    history_slider->setRange(0, 0);
+    main_toolbar_layout->addWidget(history_slider);
+
     // add a whiteboard to the layout and drop all of the margins
     whiteboard = new Whiteboard();
     whiteboard_container_layout->addWidget(whiteboard);
@@ -121,6 +238,9 @@ MainWindow::MainWindow(QWidget *parent)
     QObject::connect(whiteboard, SIGNAL(requestTextFocus()), this, SLOT(textKeyboardFocus()));
     QObject::connect(whiteboard, SIGNAL(requestRotateLeft()), this, SLOT(rotateLeft()));
     QObject::connect(whiteboard, SIGNAL(requestRotateRight()), this, SLOT(rotateRight()));
+    QObject::connect(whiteboard, SIGNAL(historyChanged()), this, SLOT(updateHistorySlider()));
+    QObject::connect(whiteboard, SIGNAL(requestQuit()), this, SLOT(quitApplication()));
+    QObject::connect(history_slider, SIGNAL(valueChanged(int)), whiteboard, SLOT(changeHistoryPosition(int)));
 
     // as the whiteboard is now defined set the title on the first image and connect a signal from the line
     // edit to change the text on the current image
@@ -217,10 +337,49 @@ MainWindow::MainWindow(QWidget *parent)
     toolbar_layout->addWidget(text_lineedit);
     QObject::connect(text_lineedit, SIGNAL(textEdited(const QString &)), whiteboard, SLOT(changeText(const QString &)));
 
+    // the viewer only shows whiteboards so everything that would change them is switched off
+    if(viewer) {
+        whiteboard->setReadOnly(true);
+        new_button->setEnabled(false);
+        compress_checkbox->setEnabled(false);
+        embed_checkbox->setEnabled(false);
+        export_png_button->setEnabled(false);
+        export_resolution_combobox->setEnabled(false);
+        export_pdf_button->setEnabled(false);
+        export_svg_button->setEnabled(false);
+        lock_button->setEnabled(false);
+        add_button->setEnabled(false);
+        duplicate_button->setEnabled(false);
+        delete_button->setEnabled(false);
+        image_title_edit->setEnabled(false);
+    }
+
+    // once the window is up see if there is anything left over from a run that didn't close properly and put the
+    // file given on the command line on screen
+    QTimer::singleShot(0, this, SLOT(startSession()));
 }
 
 // destructor for the class
 MainWindow::~MainWindow() {
+    // stop loading in any boards that haven't arrived yet
+    open_pool->waitForDone();
+    delete startup_loader;
+    stopLoading();
+
+    // let any running save finish so the file isn't left half written, and stop any running export
+    if(save_thread != NULL) {
+        save_thread->wait();
+        delete save_thread;
+    }
+    if(autosave_thread != NULL) {
+        autosave_thread->wait();
+        delete autosave_thread;
+    }
+    export_progress.cancelled.storeRelease(1);
+    export_pool->waitForDone();
+    if(export_snapshot != NULL)
+        freeWhiteboard(export_snapshot, export_total);
+
     delete tools;
     delete colours;
 }
@@ -325,6 +484,10 @@ void MainWindow::advanceTool() {
 
 // slot that will add a new image in the current place
 void MainWindow::addNewImage() {
+    // images can't be added until every board has been loaded in as the boards arrive in their original places
+    if(board_loader != NULL)
+        return;
+
     // if the current image has no title then do nothing
     if(QString::compare(image_title_edit->text(), QString(""))== 0) {
         warnNoTitle();
@@ -352,6 +515,86 @@ void MainWindow::addNewImage() {
     save_button->setEnabled(true);
 }
 
+// slot that will pick up the result of an autosave once its thread has finished
+void MainWindow::autosaveFinished() {
+    autosave_thread->wait();
+    if(autosave_discarded) {
+        // the whiteboard that was being autosaved has been saved, replaced or closed since, so get rid of anything
+        // the autosave left behind
+        QFile::remove(recovery_filename);
+    } else if(autosave_thread->succeeded()) {
+        autosave_journal = autosave_thread->journalState();
+    } else {
+        // the images were marked as autosaved when the autosave started so the next one writes the whole file
+        autosave_journal.filename = QString("");
+    }
+
+    // get rid of the thread along with its snapshot
+    delete autosave_thread;
+    autosave_thread = NULL;
+    autosave_discarded = false;
+}
+
+// slot that will write anything that has changed since the last autosave to the recovery file. all the gui thread
+// does is check the images for changes and take a snapshot of them, the writing happens on another thread
+void MainWindow::autosaveWhiteboard() {
+    // nothing to do if an autosave is still running, boards are still being loaded in or everything has already
+    // been saved by the user
+    if(autosave_thread != NULL || board_loader != NULL || !save_button->isEnabled())
+        return;
+    DrawOperations **board = whiteboard->drawOperations();
+    unsigned int total_images = whiteboard->totalImages();
+    const QVector<JournalEvent> &events = whiteboard->journalEvents(JOURNAL_AUTOSAVE);
+    if(!hasJournalChanges(board, total_images, events, JOURNAL_AUTOSAVE))
+        return;
+
+    // append to the journal of the recovery file unless there isn't one yet, it has grown too large or it doesn't
+    // embed its images the way it is asked to, in which case the whole whiteboard is written instead
+    qint64 journal_size = autosave_journal.end - autosave_journal.start;
+    bool append = autosave_journal.filename == recovery_filename && journal_size <= JOURNAL_COMPACT_SIZE &&
+        autosave_journal.embedded == embed_checkbox->isChecked();
+
+    // remember which file the user was working on so it can be saved back to after a recovery
+    QSettings settings;
+    settings.setValue("recovery/filename", filename);
+
+    // take the snapshot and hand it over to the thread. the recovery file isn't compressed as it is written often
+    DrawOperations **snapshot = snapshotWhiteboard(board, total_images);
+    autosave_thread = new SaveThread(recovery_filename, snapshot, total_images, events, JOURNAL_AUTOSAVE, autosave_journal, 0, embed_checkbox->isChecked(), false, append);
+    whiteboard->markSaved(JOURNAL_AUTOSAVE);
+    QObject::connect(autosave_thread, SIGNAL(finished()), this, SLOT(autosaveFinished()));
+    autosave_thread->start();
+}
+
+// slot that will put a board that has been loaded in the background onto the whiteboard
+void MainWindow::boardLoaded(int index) {
+    // put the board in place of its empty image
+    bool damaged = false;
+    whiteboard->replaceImage(index, board_loader->takeBoard(index, &damaged));
+    boards_damaged = boards_damaged || damaged;
+    boards_loading--;
+
+    // if the board is the one on screen then bring the UI up to date with it
+    if(index == image_selector_spinbox->value() - 1) {
+        image_title_edit->setText(whiteboard->imageTitleCurrent());
+        updateLockButton();
+        updateHistorySlider();
+        updatePendingImage();
+    }
+
+    // once every board is in the loader is no longer needed. it is deleted later as we are inside its signal.
+    // damaged boards are left empty and the file still holds them, so the next save has to write the whole whiteboard
+    if(boards_loading == 0) {
+        board_loader->deleteLater();
+        board_loader = NULL;
+        if(boards_damaged) {
+            journal.filename = QString("");
+            warnBoardsDamaged(filename);
+        }
+    }
+    updateTotalImagesLabel();
+}
+
 // slot that will react by changing the UI when the board has been modified
 void MainWindow::boardModified() {
     // enable the save button
@@ -374,10 +617,20 @@ void MainWindow::changeImage(int number) {
         return;
     }
 
-    // call the change image on the whiteboard itself and update the title to reflect the change and update the lock button
+    // call the change image on the whiteboard itself. the viewer loads the image in now if it isn't already
     whiteboard->changeImage(number);
+    if(viewer && board_loader != NULL)
+        viewBoard(number - 1);
+
+    // update the title to reflect the change and update the lock button
     image_title_edit->setText(whiteboard->imageTitleCurrent());
     updateLockButton();
+    updateHistorySlider();
+
+    // if the image hasn't been loaded in yet then load it next
+    if(whiteboard->imagePending())
+        board_loader->prioritise(number - 1);
+    updatePendingImage();
 }
 
 // slot that will update the tools in response to a tool being changed
@@ -403,6 +656,28 @@ void MainWindow::changeTools(unsigned int tool) {
         load_raster = false;
 }
 
+// slot that will ask any running save or export to stop. a save that is stopped leaves the file as it was
+void MainWindow::cancelTasks() {
+    if(save_thread != NULL)
+        save_thread->progress()->cancelled.storeRelease(1);
+    if(exporting)
+        export_progress.cancelled.storeRelease(1);
+}
+
+// slot that will rewrite the saved file without its journal once the journal has grown too large. this only
+// happens when there are no unsaved changes, otherwise it is left for the next save to ask for again
+void MainWindow::compactWhiteboard() {
+    // make sure the journal still needs compacting and that the file holds everything we have
+    if(save_thread != NULL || save_button->isEnabled() || journal.filename != filename || filename.isEmpty())
+        return;
+    qint64 journal_size = journal.end - journal.start;
+    if(journal_size <= JOURNAL_COMPACT_SIZE || journal_size <= journal.start / 2)
+        return;
+
+    // rewrite the whole file in the background. if this fails the journal is still there so nothing is lost
+    startSave(false);
+}
+
 // slot for decreasing the draw size
 void MainWindow::decreaseDrawSize() {
     // check which draw operation we have and change the appropriate spinbox
@@ -419,8 +694,8 @@ void MainWindow::decreaseDrawSize() {
 
 // slot that will delete the current image
 void MainWindow::deleteImage() {
-    // if we only have the one image then do nothing
-    if(whiteboard->totalImages() == 1 || !warnDelete())
+    // if we only have the one image or boards are still being loaded in then do nothing
+    if(whiteboard->totalImages() == 1 || board_loader != NULL || !warnDelete())
         return;
 
     // get the whiteboard to delete the current image and update the UI to show we are an image down
@@ -429,13 +704,44 @@ void MainWindow::deleteImage() {
     image_selector_spinbox->setRange(1, whiteboard->totalImages());
     total_images_label->setText(QString("/ %1").arg(whiteboard->totalImages()));
 
-    // set the title field to the title of the current image
+    // set the title field and history to those of the current image
     image_title_edit->setText(whiteboard->imageTitleCurrent());
+    updateHistorySlider();
 
     // enable the save button as the board as been modified
     save_button->setEnabled(true);
 }
 
+// slot that will add a copy of the current image immediately after it
+void MainWindow::duplicateImage() {
+    // images can't be added until every board has been loaded in as the boards arrive in their original places
+    if(board_loader != NULL)
+        return;
+
+    // if the current image has no title then do nothing
+    if(QString::compare(image_title_edit->text(), QString(""))== 0) {
+        warnNoTitle();
+        return;
+    }
+
+    // get the whiteboard to duplicate the image
+    whiteboard->duplicateImage();
+
+    // get the total number of images in the whiteboard and increase the range on the spinner. increment the spinner by 1
+    const unsigned int total_images = whiteboard->totalImages();
+    image_selector_spinbox->setRange(1, total_images);
+    image_selector_spinbox->setValue(image_selector_spinbox->value() + 1);
+    // update the label with the total number of images too
+    total_images_label->setText(QString("/ %1").arg(total_images));
+
+    // the copy carries the title and lock of the original so reflect these in the UI
+    image_title_edit->setText(whiteboard->imageTitleCurrent());
+    updateLockButton();
+
+    // enable the save button
+    save_button->setEnabled(true);
+}
+
 // slot that will go back a colour
 void MainWindow::goBackColour() {
     // determine the current colour that is selected
@@ -513,64 +819,116 @@ void MainWindow::increaseDrawSize() {
         text_size_spinbox->setValue(text_size_spinbox->value() + 1);
 }
 
-// slot that will export the current whiteboard to a set of PNG images
-void MainWindow::exportPNG() {
+// slot that will export the current whiteboard to a PDF with a page for each image
+void MainWindow::exportPDF() {
     // if the current image has no title then do nothing
     if(QString::compare(image_title_edit->text(), QString(""))== 0) {
         warnNoTitle();
         return;
     }
 
-    // first get a directory from the user
-    QString directory = QFileDialog::getExistingDirectory(this, "Export directory", "",  QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
+    // only one export runs at a time and only once every board has been loaded in
+    if(exporting || board_loader != NULL)
+        return;
 
-    // get the total number of images in the whiteboard and then start cycling through the images for export
-    const unsigned int total_images = whiteboard->totalImages();
-    for(unsigned int i = 0; i < total_images; i++) {
-        // get the image for the current board
-        QImage *image = whiteboard->exportBoard(i);
+    // get the file to export to from the user. if no file is picked then don't do anything
+    QString pdf_filename = QFileDialog::getSaveFileName(this, "Export PDF", "", "PDF Files (*.pdf)");
+    if(pdf_filename.compare(QString("")) == 0)
+        return;
+    if(!pdf_filename.endsWith(QString(".pdf"), Qt::CaseInsensitive))
+        pdf_filename += QString(".pdf");
+
+    // the pages all go into the one file so they are written one after the other on a single thread
+    startExport(1);
+    export_pool->start(new PDFExportTask(export_snapshot, export_total, pdf_filename, &export_progress));
+}
 
-        // generate a filename for this board. we pad this out to three digits to
-        // ensure the filenames all appear in the coorect order.
-        QString filename;
-        if(i + 1 < 10)
-            filename = QString("/00%1.png").arg(i + 1);
-        else if(i + 1 < 100)
-            filename = QString("/0%1.png").arg(i + 1);
-        else
-            filename = QString("/%1.png").arg(i + 1);
+// slot that will export the current whiteboard to a set of PNG images
+void MainWindow::exportPNG() {
+    // if the current image has no title then do nothing
+    if(QString::compare(image_title_edit->text(), QString(""))== 0) {
+        warnNoTitle();
+        return;
+    }
 
-        // generate the full path and save the file and delete the image
-        image->save(directory + filename, "PNG");
+    // only one export runs at a time and only once every board has been loaded in
+    if(exporting || board_loader != NULL)
+        return;
 
+    // work out the scale to export at, asking for the dpi if a custom one was picked
+    qreal scale = 1;
+    int resolution = export_resolution_combobox->currentIndex();
+    if(resolution < (int) TOTAL_EXPORT_RESOLUTIONS) {
+        scale = EXPORT_RESOLUTION_SCALES[resolution];
+    } else {
+        bool accepted = false;
+        int dpi = QInputDialog::getInt(this, "Export DPI", "Dots per inch", EXPORT_BASE_DPI, 1, EXPORT_BASE_DPI * EXPORT_MAX_SCALE, 1, &accepted);
+        if(!accepted)
+            return;
+        scale = dpi / EXPORT_BASE_DPI;
     }
+
+    // first get a directory from the user. if no directory is selected then don't do anything
+    QString directory = QFileDialog::getExistingDirectory(this, "Export directory", "",  QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
+    if(directory.compare(QString("")) == 0)
+        return;
+
+    // hand each board over to be drawn and written on the export threads. boards only take up memory while they
+    // are being drawn and written, so the threads are limited to however many images fit into the memory budget
+    startExport(exportThreadCount(scale));
+    for(unsigned int i = 0; i < export_total; i++)
+        export_pool->start(new BoardExportTask(export_snapshot[i], i, export_total, scale, directory + exportFilename(i, QString("png")), &export_progress));
 }
 
-// slot that will go through the process of loading a whiteboard from disk
-void MainWindow::loadImages() {
-    // get the filename that we want to load. if no file is selected then don't do anything
-    QString filename = QFileDialog::getOpenFileName(this, "Open Whiteboard", "", "Whiteboard Files (*.wbd)");
-    if(filename.compare(QString("")) == 0)
+// slot that will export the current whiteboard to a set of SVG documents
+void MainWindow::exportSVG() {
+    // if the current image has no title then do nothing
+    if(QString::compare(image_title_edit->text(), QString(""))== 0) {
+        warnNoTitle();
         return;
+    }
 
-    // read in the whiteboard
-    unsigned int total_images = 0;
-    unsigned int max_images = 0;
-    DrawOperations **board = loadWhiteboard(filename, &total_images, &max_images);
+    // only one export runs at a time and only once every board has been loaded in
+    if(exporting || board_loader != NULL)
+        return;
 
-    // set the images on the whiteboard and reset its current image to one
-    whiteboard->setDrawOperations(board, total_images, max_images);
-    image_selector_spinbox->setRange(1, total_images);
-    image_selector_spinbox->setValue(1);
-    total_images_label->setText(QString("/ %1").arg(total_images));
-    image_title_edit->setText(board[0]->title);
+    // first get a directory from the user. if no directory is selected then don't do anything
+    QString directory = QFileDialog::getExistingDirectory(this, "Export directory", "",  QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
+    if(directory.compare(QString("")) == 0)
+        return;
 
-    // as there is no modification at this point disable the save button
-    save_button->setEnabled(false);
+    // hand each board over to be drawn and written on the export threads. the documents are built up as they are
+    // drawn without any images being held in memory so every core can be used
+    startExport(QThread::idealThreadCount());
+    for(unsigned int i = 0; i < export_total; i++)
+        export_pool->start(new SVGExportTask(export_snapshot[i], i, export_total, directory + exportFilename(i, QString("svg")), &export_progress));
+}
 
-    // update the lock button to reflect the status of the first image
-    updateLockButton();
+// slot that will go through the process of loading a whiteboard from disk
+void MainWindow::loadImages() {
+    // get the filename that we want to load, showing the cover of whichever file is picked out. the dialog has to be
+    // qt's own rather than the native one for the preview to be added to it
+    QFileDialog dialog(this, "Open Whiteboard", "", "Whiteboard Files (*.wbd)");
+    dialog.setFileMode(QFileDialog::ExistingFile);
+    dialog.setOption(QFileDialog::DontUseNativeDialog, true);
+    open_preview_label = new QLabel(&dialog);
+    open_preview_label->setFixedSize(COVER_WIDTH, COVER_HEIGHT);
+    open_preview_label->setAlignment(Qt::AlignCenter);
+    QGridLayout *dialog_layout = qobject_cast<QGridLayout *>(dialog.layout());
+    if(dialog_layout != NULL)
+        dialog_layout->addWidget(open_preview_label, 0, dialog_layout->columnCount(), dialog_layout->rowCount(), 1);
+    QObject::connect(&dialog, SIGNAL(currentChanged(const QString &)), this, SLOT(previewWhiteboard(const QString &)));
+    bool accepted = dialog.exec() == QDialog::Accepted;
+    open_preview_label = NULL;
+
+    // if no file is selected then don't do anything
+    if(!accepted || dialog.selectedFiles().isEmpty())
+        return;
+    QString load_filename = dialog.selectedFiles().first();
 
+    // open the whiteboard. the current whiteboard is only replaced if this works
+    BoardLoader *loader = new BoardLoader(load_filename, viewer, this);
+    showOpenedFile(load_filename, loader, loader->open(&open_journal));
 }
 
 // slot that will load an image for drawing onto the board
@@ -611,6 +969,73 @@ void MainWindow::lockUnlockImage() {
     }
 }
 
+// function that will offer to restore the whiteboard from the recovery file if the last run didn't close properly.
+// this returns true if the whiteboard was restored
+bool MainWindow::offerRecovery() {
+    // the recovery file is deleted whenever the application quits properly so there is nothing to do without it
+    if(!QFile::exists(recovery_filename))
+        return false;
+
+    // ask the user if they want the autosaved whiteboard back. if not then it is thrown away
+    QMessageBox recovery_messagebox;
+    recovery_messagebox.setText("The whiteboard was not closed properly last time. Do you want to restore it from the last autosave?");
+    recovery_messagebox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+    recovery_messagebox.setDefaultButton(QMessageBox::Yes);
+    if(recovery_messagebox.exec() == QMessageBox::No) {
+        removeRecoveryFile();
+        return false;
+    }
+
+    // read in the recovery file. later autosaves carry on appending to its journal
+    unsigned int total_images = 0;
+    unsigned int max_images = 0;
+    bool damaged = false;
+    DrawOperations **board = loadWhiteboard(recovery_filename, &total_images, &max_images, &autosave_journal, &damaged);
+    if(board == NULL) {
+        warnLoadFailed(recovery_filename);
+        removeRecoveryFile();
+        return false;
+    }
+
+    // damaged boards are left empty and the recovery file still holds them, so the next autosave writes it in full
+    if(damaged) {
+        autosave_journal.filename = QString("");
+        warnBoardsDamaged(recovery_filename);
+    }
+
+    // saves go back to the file the user was working on. that file doesn't hold what was recovered so the first
+    // save writes the whole whiteboard to it
+    QSettings settings;
+    filename = settings.value("recovery/filename", QString("")).toString();
+    journal.filename = QString("");
+    showLoadedWhiteboard(board, total_images, max_images);
+    save_button->setEnabled(true);
+    return true;
+}
+
+// slot that will show the cover of the file picked out in the open dialog. only the previews at the start of the
+// file are read so this stays quick however large the whiteboard is
+void MainWindow::previewWhiteboard(const QString &preview_filename) {
+    if(open_preview_label == NULL)
+        return;
+    QByteArray cover;
+    QVector<QByteArray> thumbnails;
+    QPixmap pixmap;
+    if(loadPreviews(preview_filename, &cover, thumbnails) && pixmap.loadFromData(cover)) {
+        open_preview_label->setPixmap(pixmap);
+        open_preview_label->setToolTip(QString("%1 images").arg(thumbnails.size()));
+    } else {
+        open_preview_label->setPixmap(QPixmap());
+        open_preview_label->setText("No preview");
+        open_preview_label->setToolTip(QString(""));
+    }
+}
+
+// slot that will close the window, and with it the application, when the whiteboard asks to quit
+void MainWindow::quitApplication() {
+    close();
+}
+
 // slot that will decrease rotation to the left by 45 degrees
 void MainWindow::rotateLeft() {
     // check if the rotation is enabled
@@ -641,8 +1066,9 @@ void MainWindow::rotateRight() {
 
 // slot that will go through the process of saving a whiteboard to disk
 void MainWindow::saveImages() {
-    // if the save button is disabled then there has been no modification so do nothing
-    if(save_button->isEnabled() == false)
+    // if the save button is disabled then there has been no modification so do nothing. the whiteboard can't be
+    // saved until every board has been loaded in
+    if(save_button->isEnabled() == false || board_loader != NULL)
         return;
 
     // if the current image has no title then do nothing
@@ -663,12 +1089,127 @@ void MainWindow::saveImages() {
         filename = temp;
     }
 
-    // save the whiteboard to disk
-    saveWhiteboard(filename, whiteboard->drawOperations(), whiteboard->totalImages());
+    // if the file we are saving to has a journal then just append the changes to it, otherwise write the whole
+    // whiteboard to disk. the whole file is also written if the images are to be embedded or not when they weren't
+    // before
+    startSave(filename == journal.filename && journal.embedded == embed_checkbox->isChecked());
+}
+
+// slot that will pick up the result of a save once its thread has finished
+void MainWindow::saveFinished() {
+    // the result may have already been picked up when the window was closed
+    if(save_thread == NULL)
+        return;
+
+    // the journal is only ours to update if we are still working on the file that was saved
+    save_thread->wait();
+    bool same_file = save_thread->filename() == filename && journal.filename == filename;
+    bool success = save_thread->succeeded();
+    if(success && save_thread->filename() == filename) {
+        journal = save_thread->journalState();
+
+        // if nothing has changed since then the saved file holds everything so there is nothing left to recover
+        if(!save_button->isEnabled())
+            removeRecoveryFile();
+    } else if(!success) {
+        // the images were marked as saved when the save started so the next save has to write the whole file
+        // again. the file itself is left as it was before the save
+        if(same_file)
+            journal.filename = QString("");
+        save_button->setEnabled(true);
+        if(!save_thread->progress()->cancelled.loadAcquire())
+            warnSaveFailed();
+    }
+
+    // hold on to the thumbnails drawn for the save for the images that haven't changed since, so the next save
+    // doesn't have to draw them again
+    if(success)
+        whiteboard->updateThumbnails(save_thread->snapshotImages(), save_thread->totalImages());
+
+    // get rid of the thread along with its snapshot and bring the progress up to date
+    delete save_thread;
+    save_thread = NULL;
+    updateTasks();
 
-    // disable the save button as we are now in a non modified state
+    // once the journal has grown too large rewrite the file without it a little while after the save
+    qint64 journal_size = journal.end - journal.start;
+    if(success && journal_size > JOURNAL_COMPACT_SIZE && journal_size > journal.start / 2)
+        QTimer::singleShot(JOURNAL_COMPACT_DELAY, this, SLOT(compactWhiteboard()));
+}
+
+// function that will start saving a snapshot of the whiteboard on another thread, either appending the changes to
+// the journal of the file or writing the whole whiteboard. the snapshot shares the operations of every image so it
+// is taken instantly, and drawing can carry on while it is written
+void MainWindow::startSave(bool append) {
+    // only one save runs at a time, the save button stays enabled so the changes can be saved once it is done
+    if(save_thread != NULL || board_loader != NULL)
+        return;
+
+    // take the snapshot and hand it over to the thread. a whole file starts with its previews, which the thread
+    // draws from the snapshot. appending leaves the previews in the file as they are until it is next rewritten
+    int compression_level = compress_checkbox->isChecked() ? DEFAULT_COMPRESSION_LEVEL : 0;
+    DrawOperations **snapshot = snapshotWhiteboard(whiteboard->drawOperations(), whiteboard->totalImages());
+    save_thread = new SaveThread(filename, snapshot, whiteboard->totalImages(), whiteboard->journalEvents(JOURNAL_SAVE), JOURNAL_SAVE, journal, compression_level, embed_checkbox->isChecked(), true, append);
+
+    // everything in the snapshot will be in the file once the save is done, so anything changed from here on is
+    // left for the next save. if the save fails this is undone by writing the whole file next time
+    whiteboard->markSaved(JOURNAL_SAVE);
     save_button->setEnabled(false);
 
+    // start the save and show its progress
+    QObject::connect(save_thread, SIGNAL(finished()), this, SLOT(saveFinished()));
+    save_thread->start();
+    startTaskProgress();
+}
+
+// function that will take a snapshot of the whiteboard for an export to work on and start the export off. the
+// snapshot lets drawing carry on while the whiteboard is exported and is freed once the export has finished
+void MainWindow::startExport(int threads) {
+    export_total = whiteboard->totalImages();
+    export_snapshot = snapshotWhiteboard(whiteboard->drawOperations(), export_total);
+    export_progress.done.storeRelease(0);
+    export_progress.cancelled.storeRelease(0);
+    export_progress.failed.storeRelease(0);
+    export_pool->setMaxThreadCount(threads);
+    exporting = true;
+    startTaskProgress();
+}
+
+// function that will show the progress of the running tasks and keep it up to date
+void MainWindow::startTaskProgress() {
+    task_progress_bar->setVisible(true);
+    cancel_button->setVisible(true);
+    updateTasks();
+    task_timer->start();
+}
+
+// slot that will finish starting up once the window is up. a whiteboard left over from a run that didn't close
+// properly is offered back first, otherwise the file given on the command line is put on screen once it has
+// been read in
+void MainWindow::startSession() {
+    // the viewer leaves the recovery file for the next time the whiteboard is edited
+    open_pool->waitForDone();
+    if(!viewer && offerRecovery()) {
+        delete startup_loader;
+        startup_loader = NULL;
+        return;
+    }
+    if(startup_loader == NULL)
+        return;
+
+    // hand the loader over to be shown and log how long it took to get the file on screen
+    BoardLoader *loader = startup_loader;
+    startup_loader = NULL;
+    showOpenedFile(startup_filename, loader, startup_opened);
+    std::cout << "opened " << startup_filename.toStdString() << " " << startup_timer.elapsed() << "ms after startup" << std::endl;
+}
+
+// function that will stop loading in the boards of a whiteboard that is still being opened. any boards that
+// haven't arrived are thrown away along with the loader
+void MainWindow::stopLoading() {
+    delete board_loader;
+    board_loader = NULL;
+    boards_loading = 0;
 }
 
 // slot that will start a new whiteboard and reset everything
@@ -686,8 +1227,11 @@ void MainWindow::startNewWhiteboard() {
     if(result == QMessageBox::No)
         return;
 
-    // set the filename to nothing
+    // set the filename to nothing, there is no longer a file with a journal to add to or anything to recover
+    stopLoading();
     filename = QString("");
+    journal.filename = QString("");
+    removeRecoveryFile();
 
     // ask the whiteboard to reset itself. then reset the UI to reflect this
     whiteboard->resetWhiteBoard();
@@ -696,6 +1240,8 @@ void MainWindow::startNewWhiteboard() {
     image_title_edit->setText("Placeholder title");
     whiteboard->changeImageTitle(QString("Placeholder title"));
     updateLockButton();
+    updateHistorySlider();
+    updatePendingImage();
     save_button->setEnabled(false);
 }
 
@@ -716,11 +1262,88 @@ void MainWindow::titleKeyboardFocus() {
     image_title_edit->setFocus(Qt::OtherFocusReason);
 }
 
+// slot that will finish off a running export once its boards are written and update the progress of the running tasks
+void MainWindow::updateTasks() {
+    // the export is done once every board has been written or skipped over after a cancel, at which point nothing
+    // is using the snapshot anymore
+    if(exporting && (unsigned int) export_progress.done.loadAcquire() == export_total) {
+        freeWhiteboard(export_snapshot, export_total);
+        export_snapshot = NULL;
+        exporting = false;
+    }
+
+    // once nothing is running hide the progress again
+    if(save_thread == NULL && !exporting) {
+        task_timer->stop();
+        task_progress_bar->setVisible(false);
+        cancel_button->setVisible(false);
+        return;
+    }
+
+    // the progress bar covers every board of everything that is running
+    int maximum = 0, value = 0;
+    if(save_thread != NULL) {
+        maximum += save_thread->totalImages();
+        value += save_thread->progress()->done.loadAcquire();
+    }
+    if(exporting) {
+        maximum += export_total;
+        value += export_progress.done.loadAcquire();
+    }
+    task_progress_bar->setRange(0, maximum);
+    task_progress_bar->setValue(value);
+}
+
+// slot that will update the history slider to cover all of the operations of the current image
+void MainWindow::updateHistorySlider() {
+    // block the signals while we update the slider so the whiteboard isn't sent back into its history
+    history_slider->blockSignals(true);
+    history_slider->setRange(0, whiteboard->totalOps());
+    history_slider->setValue(whiteboard->historyPosition());
+    history_slider->blockSignals(false);
+}
+
 // slot that will save the current whiteboard
 void MainWindow::whiteboardSave() {
     saveImages();
 }
 
+// overridden closeEvent method that checks for unsaved changes and tidies up the recovery file before quitting
+void MainWindow::closeEvent(QCloseEvent *event) {
+    // the save button stays disabled while a save is running, so wait for it to finish and pick up its result
+    // first. if it failed the save button is enabled again and the changes are treated as unsaved
+    if(save_thread != NULL) {
+        save_thread->wait();
+        saveFinished();
+    }
+
+    // give the user a chance to go back and save their changes
+    if(save_button->isEnabled() && !warnUnsaved()) {
+        event->ignore();
+        return;
+    }
+
+    // stop loading in any boards and let any running autosave finish before the recovery file is deleted, as the
+    // application is quitting properly there is nothing to recover next time
+    stopLoading();
+    if(autosave_thread != NULL)
+        autosave_thread->wait();
+    removeRecoveryFile();
+
+    // reset the cursor to the default before going any further
+    QApplication::setOverrideCursor(QCursor(Qt::ArrowCursor));
+    event->accept();
+}
+
+// overridden paintEvent method that logs how long it took from startup to the window first being painted
+void MainWindow::paintEvent(QPaintEvent *event) {
+    QWidget::paintEvent(event);
+    if(!first_painted) {
+        std::cout << "first paint " << startup_timer.elapsed() << "ms after startup" << std::endl;
+        first_painted = true;
+    }
+}
+
 // refactored function that will generate and return a colour sleector with the given colour
 // this will also set up the appropriate signals
 ColourSelector *MainWindow::generateColourSelector(QHBoxLayout *layout, int red, int green, int blue) {
@@ -773,6 +1396,90 @@ ToolSelector *MainWindow::generateToolSelector(QHBoxLayout *layout, const unsign
     return tool_selector;
 }
 
+// function that will delete the recovery file as what it holds is no longer needed. if an autosave is still
+// running the file is deleted again once it has finished. the viewer never autosaves so the recovery file belongs
+// to someone else and is left alone
+void MainWindow::removeRecoveryFile() {
+    if(viewer)
+        return;
+    if(autosave_thread != NULL)
+        autosave_discarded = true;
+    QFile::remove(recovery_filename);
+    autosave_journal.filename = QString("");
+    QSettings settings;
+    settings.remove("recovery/filename");
+}
+
+// function that will put a whiteboard that has been read in onto the screen and bring the UI up to date
+void MainWindow::showLoadedWhiteboard(DrawOperations **board, unsigned int total_images, unsigned int max_images) {
+    // set the images on the whiteboard and reset its current image to one
+    whiteboard->setDrawOperations(board, total_images, max_images);
+    image_selector_spinbox->setRange(1, total_images);
+    image_selector_spinbox->setValue(1);
+    updateTotalImagesLabel();
+    image_title_edit->setText(board[0]->title);
+
+    // update the lock button and history to reflect the status of the first image
+    updateLockButton();
+    updateHistorySlider();
+    updatePendingImage();
+}
+
+// function that will put a whiteboard that has been opened by the given loader on screen, with the boards after
+// the first picked up as they are loaded in if it is opening the file progressively. if the file couldn't be
+// opened then the user is told and the current whiteboard is left alone
+void MainWindow::showOpenedFile(const QString &load_filename, BoardLoader *loader, bool opened) {
+    if(!opened) {
+        delete loader;
+        warnLoadFailed(load_filename);
+        return;
+    }
+
+    // take over the new loader. the old one is only stopped once its boards are off the screen, as the boards of the
+    // viewer use images that sit in its file
+    BoardLoader *previous_loader = board_loader;
+    board_loader = loader;
+    unsigned int total_images = 0;
+    unsigned int max_images = 0;
+    DrawOperations **board = board_loader->start(&total_images, &max_images);
+
+    // later saves go back to the file that was loaded so they can be appended to its journal. the recovery file
+    // holds the old whiteboard so it is thrown away
+    filename = load_filename;
+    journal = open_journal;
+    removeRecoveryFile();
+    embed_checkbox->setChecked(journal.embedded);
+
+    // as there is no modification at this point disable the save button
+    showLoadedWhiteboard(board, total_images, max_images);
+    save_button->setEnabled(false);
+    delete previous_loader;
+
+    // damaged boards of a whole whiteboard have been left empty, so the next save has to write the whole file
+    if(board_loader->damaged()) {
+        journal.filename = QString("");
+        warnBoardsDamaged(filename);
+    }
+
+    // the loader is only needed if there are boards still to come. the viewer keeps it to load each board as it is
+    // viewed
+    boards_loading = board_loader->progressive() && !viewer ? total_images - 1 : 0;
+    boards_damaged = false;
+    viewed_boards.clear();
+    viewed_boards.append(0);
+    if(boards_loading == 0 && !(viewer && board_loader->progressive())) {
+        stopLoading();
+        return;
+    }
+
+    // mark every board but the first as still being loaded in and pick each one up as it arrives
+    QVector<bool> pending(total_images, true);
+    pending[0] = false;
+    whiteboard->setPendingImages(pending);
+    QObject::connect(board_loader, SIGNAL(boardLoaded(int)), this, SLOT(boardLoaded(int)));
+    updateTotalImagesLabel();
+}
+
 // refactored function that will update the text on the lock button depending on the lock state of the current image
 void MainWindow::updateLockButton() {
     // check to see if the current image is locked or not and update the lock button to reflect this
@@ -782,6 +1489,45 @@ void MainWindow::updateLockButton() {
         lock_button->setText("Lock");
 }
 
+// function that will stop the title and lock of the current image being changed while it is still being loaded in
+void MainWindow::updatePendingImage() {
+    bool pending = whiteboard->imagePending();
+    image_title_edit->setEnabled(!pending && !viewer);
+    lock_button->setEnabled(!pending && !viewer);
+}
+
+// function that will load the given board for the viewer if it isn't already. only the boards viewed most recently
+// are kept, the one viewed longest ago is thrown away along with any images only it was using
+void MainWindow::viewBoard(unsigned int index) {
+    viewed_boards.removeOne(index);
+    viewed_boards.prepend(index);
+    if(whiteboard->imagePending()) {
+        bool damaged = false;
+        whiteboard->replaceImage(index, board_loader->viewBoard(index, &damaged));
+        if(damaged)
+            warnBoardsDamaged(filename);
+    }
+    if(viewed_boards.size() > VIEWER_CACHED_BOARDS) {
+        whiteboard->unloadImage(viewed_boards.takeLast());
+        board_loader->trimAssets();
+    }
+}
+
+// function that will update the label showing how many images there are and how many are still being loaded in
+void MainWindow::updateTotalImagesLabel() {
+    if(boards_loading > 0)
+        total_images_label->setText(QString("/ %1 (%2 loading)").arg(whiteboard->totalImages()).arg(boards_loading));
+    else
+        total_images_label->setText(QString("/ %1").arg(whiteboard->totalImages()));
+}
+
+// function that will throw up a dialog warning that some of the boards of a whiteboard were damaged
+void MainWindow::warnBoardsDamaged(const QString &damaged_filename) {
+    QMessageBox warning;
+    warning.setText(QString("Some of the images in %1 were damaged and have been left empty").arg(damaged_filename));
+    warning.exec();
+}
+
 // function that will ask if the user is sure that they want to delete an image. true means the image
 // is to be deleted
 bool MainWindow::warnDelete() {
@@ -797,6 +1543,30 @@ bool MainWindow::warnDelete() {
         return false;
 }
 
+// function that will throw up a dialog warning that the whiteboard could not be saved
+void MainWindow::warnSaveFailed() {
+    QMessageBox warning;
+    warning.setText(QString("Could not save the whiteboard to %1. The previously saved copy has been left as it was").arg(filename));
+    warning.exec();
+}
+
+// function that will ask if the user is sure that they want to quit with unsaved changes. true means the
+// application is to quit
+bool MainWindow::warnUnsaved() {
+    QMessageBox quit_messagebox;
+    quit_messagebox.setText("The whiteboard has unsaved changes. Are you sure you want to quit? The changes will be lost");
+    quit_messagebox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+    quit_messagebox.setDefaultButton(QMessageBox::No);
+    return quit_messagebox.exec() == QMessageBox::Yes;
+}
+
+// function that will throw up a dialog warning that a whiteboard could not be loaded
+void MainWindow::warnLoadFailed(const QString &load_filename) {
+    QMessageBox warning;
+    warning.setText(QString("Could not load the whiteboard from %1. The file is either unreadable or damaged").arg(load_filename));
+    warning.exec();
+}
+
 // function that will throw up a dialog warning that the image cannot be changed unless a title is entered
 void MainWindow::warnNoTitle() {
     // emit a message stating that we cannot change unless a title is entered
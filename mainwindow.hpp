@@ -6,14 +6,26 @@
 // class that defines a fullscreen window that will have options for assisting with the whiteboard
 
 // includes
+#include <QCheckBox>
+#include <QCloseEvent>
+#include <QComboBox>
+#include <QElapsedTimer>
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QLineEdit>
+#include <QList>
+#include <QPaintEvent>
+#include <QProgressBar>
 #include <QPushButton>
+#include <QSlider>
 #include <QSpinBox>
 #include <QString>
+#include <QThreadPool>
+#include <QTimer>
 #include <QWidget>
+#include "backgroundtasks.hpp"
 #include "colourselector.hpp"
+#include "fileops.hpp"
 #include "toolselector.hpp"
 #include "whiteboard.hpp"
 
@@ -23,8 +35,9 @@ class MainWindow : public QWidget {
     Q_OBJECT
 // public section of the class
 public:
-    // default constructor for the class
-    MainWindow(QWidget *parent = 0);
+    // constructor for the class. the file given is opened as soon as the window is up, and how long startup takes
+    // is measured from when the timer was started. the viewer opens whiteboards read only
+    MainWindow(const QElapsedTimer &startup_timer, const QString &startup_filename = QString(""), bool viewer = false, QWidget *parent = 0);
     // destructor for the class
     ~MainWindow();
 // private slots of the class
@@ -39,8 +52,18 @@ private slots:
     void advanceTool();
     // slot that will add a new image to the whiteboard immediately after the current image
     void addNewImage();
+    // slot that will pick up the result of an autosave once its thread has finished
+    void autosaveFinished();
+    // slot that will write anything that has changed since the last autosave to the recovery file
+    void autosaveWhiteboard();
+    // slot that will rewrite the saved file without its journal once the journal has grown too large
+    void compactWhiteboard();
+    // slot that will put a board that has been loaded in the background onto the whiteboard
+    void boardLoaded(int index);
     // slot that will react by changing the UI when the board has been modified
     void boardModified();
+    // slot that will ask any running save or export to stop
+    void cancelTasks();
     // slot that will update the colour selectors in response to a tool being changed
     void changeColour(int red, int green, int blue);
     // slot that will change the current image
@@ -51,6 +74,8 @@ private slots:
     void decreaseDrawSize();
     // slot that will delete the current image
     void deleteImage();
+    // slot that will add a copy of the current image immediately after it
+    void duplicateImage();
     // slot that will go back a colour
     void goBackColour();
     // slot that will go back an image
@@ -59,30 +84,53 @@ private slots:
     void goBackTool();
     // slot for increasing the draw size
     void increaseDrawSize();
+    // slot that will export the current whiteboard to a PDF with a page for each image
+    void exportPDF();
     // slot that will export the current whiteboard to a set of PNG images
     void exportPNG();
+    // slot that will export the current whiteboard to a set of SVG documents
+    void exportSVG();
     // slot that will run through the process of loading a set of images for a whiteboard
     void loadImages();
     // slot that will load an image for drawing onto the board
     void loadJpgPngSvgImage();
     // slot that will lock and unlock the current image
     void lockUnlockImage();
+    // slot that will show the cover of the file picked out in the open dialog
+    void previewWhiteboard(const QString &preview_filename);
+    // slot that will close the window, and with it the application, when the whiteboard asks to quit
+    void quitApplication();
     // slot that will decrease rotation to the left by 45 degrees
     void rotateLeft();
     // slot that will increase the rotation to the right by 45 degrees
     void rotateRight();
     // slot that will run through the process of saving an image
     void saveImages();
+    // slot that will pick up the result of a save once its thread has finished
+    void saveFinished();
     // slot that will start a new whiteboard but will warn the user beforehand
     void startNewWhiteboard();
+    // slot that will offer back anything left over from a run that didn't close properly and otherwise put the
+    // file given on the command line on screen once the window is up
+    void startSession();
     // slot that will put keyboard focus on the text to be inserted
     void textKeyboardFocus();
     // slot that will enable the save button when the title on an image has been changed
     void titleChanged(const QString &text);
     // slot that will put keyboard focus on the image title when requested
     void titleKeyboardFocus();
+    // slot that will update the history slider to cover all of the operations of the current image
+    void updateHistorySlider();
+    // slot that will finish off a running export once its boards are written and update the progress of the running tasks
+    void updateTasks();
     // slot that will save the current whiteboard
     void whiteboardSave();
+// protected section of the class
+protected:
+    // overridden closeEvent method that checks for unsaved changes and tidies up the recovery file before quitting
+    void closeEvent(QCloseEvent *event);
+    // overridden paintEvent method that logs how long it took from startup to the window first being painted
+    void paintEvent(QPaintEvent *event);
 // private section of the class
 private:
     // function that will generate and attach a colour picker to the given layout
@@ -93,13 +141,49 @@ private:
     QWidget *generateToolbar();
     // function that will generate and attach the given tool selector to the given layout
     ToolSelector *generateToolSelector(QHBoxLayout *layout, const unsigned int operation);
+    // function that will offer to restore the whiteboard from the recovery file if the last run didn't close
+    // properly. this returns true if the whiteboard was restored
+    bool offerRecovery();
+    // function that will delete the recovery file as what it holds is no longer needed
+    void removeRecoveryFile();
+    // function that will put a whiteboard that has been read in onto the screen and bring the UI up to date
+    void showLoadedWhiteboard(DrawOperations **board, unsigned int total_images, unsigned int max_images);
+    // function that will put a whiteboard that has been opened by the given loader on screen, or warn the user if
+    // it couldn't be opened
+    void showOpenedFile(const QString &load_filename, BoardLoader *loader, bool opened);
+    // function that will start saving a snapshot of the whiteboard on another thread, either appending the changes
+    // to the journal of the file or writing the whole whiteboard
+    void startSave(bool append);
+    // function that will take a snapshot of the whiteboard for an export to work on and start the export off on the
+    // given number of threads. the tasks of the export are queued on the export pool once this has been called
+    void startExport(int threads);
+    // function that will show the progress of the running tasks and keep it up to date
+    void startTaskProgress();
+    // function that will stop loading in the boards of a whiteboard that is still being opened
+    void stopLoading();
     // refactored function that will update the text on the lock button depending on the lock state of the current image
     void updateLockButton();
+    // function that will stop the title and lock of the current image being changed while it is still being loaded in
+    void updatePendingImage();
+    // function that will update the label showing how many images there are and how many are still being loaded in
+    void updateTotalImagesLabel();
+    // function that will load the given board for the viewer if it isn't already, throwing away the board viewed
+    // longest ago once too many are held
+    void viewBoard(unsigned int index);
+    // function that will throw up a dialog warning that some of the boards of the given whiteboard were damaged
+    void warnBoardsDamaged(const QString &damaged_filename);
     // function that will ask if the user is sure that they want to delete an image. true means the image
     // is to be deleted
     bool warnDelete();
+    // function that will throw up a dialog warning that a whiteboard could not be loaded
+    void warnLoadFailed(const QString &load_filename);
     // function that will throw up a dialog warning that the image cannot be changed unless a title is entered
     void warnNoTitle();
+    // function that will throw up a dialog warning that the whiteboard could not be saved
+    void warnSaveFailed();
+    // function that will ask if the user is sure that they want to quit with unsaved changes. true means the
+    // application is to quit
+    bool warnUnsaved();
     // whiteboard that everything will be drawn on
     Whiteboard *whiteboard;
     // spinboxes for determining the point size and line thickness
@@ -108,8 +192,25 @@ private:
     QSpinBox *image_selector_spinbox;
     // label stating how many images we have
     QLabel *total_images_label;
+    // slider for scrubbing the current image through its history
+    QSlider *history_slider;
     // the name of the file that we are saving. if this is empty then a user has not chosen a name yet
     QString filename;
+    // the journal of the file the whiteboard was last loaded from or saved to, and of the file being opened
+    JournalState journal;
+    JournalState open_journal;
+    // when the application started, whether the window has been painted yet and the file given on the command line
+    QElapsedTimer startup_timer;
+    bool first_painted;
+    QString startup_filename;
+    // is the window a read only viewer and the boards it is holding, the most recently viewed first
+    bool viewer;
+    QList<unsigned int> viewed_boards;
+    // the pool that reads in the file given on the command line while the window is set up, the loader reading it
+    // and whether it was opened
+    QThreadPool *open_pool;
+    BoardLoader *startup_loader;
+    bool startup_opened;
     // spinbox for selecting the size of our text
     QSpinBox *text_size_spinbox;
     // spinbox for selecting the rotation of our text
@@ -124,6 +225,42 @@ private:
     ColourSelector **colours;
     // the save button of the window
     QPushButton *save_button;
+    // checkbox for whether the whiteboard is compressed when it is saved
+    QCheckBox *compress_checkbox;
+    // checkbox for whether the images are embedded in the whiteboard file when it is saved
+    QCheckBox *embed_checkbox;
+    // combo box for the resolution the whiteboard is exported at
+    QComboBox *export_resolution_combobox;
+    // the thread saving the whiteboard. this is null when no save is running
+    SaveThread *save_thread;
+    // the recovery file that is autosaved to, the journal it holds and the timer that triggers the autosave
+    QString recovery_filename;
+    JournalState autosave_journal;
+    QTimer *autosave_timer;
+    // the thread autosaving the whiteboard, which is null when no autosave is running, and whether what it is
+    // writing has been thrown away since it started
+    SaveThread *autosave_thread;
+    bool autosave_discarded;
+    // the loader of the whiteboard being opened, which is null when no boards are being loaded in, how many boards
+    // it has still to load and whether any of them were damaged
+    BoardLoader *board_loader;
+    unsigned int boards_loading;
+    bool boards_damaged;
+    // the label showing the cover of the file picked out in the open dialog, which is null when the dialog isn't up
+    QLabel *open_preview_label;
+    // the thread pool that draws and writes exported boards and the progress of the running export
+    QThreadPool *export_pool;
+    TaskProgress export_progress;
+    // the snapshot of the whiteboard being exported and how many boards it has
+    DrawOperations **export_snapshot;
+    unsigned int export_total;
+    // is an export running
+    bool exporting;
+    // timer that keeps the progress bar up to date while tasks are running
+    QTimer *task_timer;
+    // progress bar and cancel button that are shown while a save or export is running
+    QProgressBar *task_progress_bar;
+    QPushButton *cancel_button;
     // the load image button of the window
     QPushButton *load_image_pushbutton;
     // the filename of the image we are loading
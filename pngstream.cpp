@@ -0,0 +1,135 @@
+// pngstream.cpp
+//
+// implements the class in pngstream.hpp
+
+// includes
+#include <QtEndian>
+#include "pngstream.hpp"
+
+// the eight bytes every PNG file starts with
+static const char PNG_SIGNATURE[8] = {(char) 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+// how much compressed data is gathered up before it is written out as a chunk of the file
+static const int PNG_CHUNK_SIZE = 65536;
+
+// functions
+
+// function that will add the given value onto the end of the data in the byte order of a PNG file
+static void appendBigEndian(QByteArray &data, quint32 value) {
+    uchar bytes[4];
+    qToBigEndian(value, bytes);
+    data.append((const char *) bytes, 4);
+}
+
+// constructor for the class
+PNGStreamWriter::PNGStreamWriter(const QString &filename, int width, int height, qreal dpi)
+: file(filename), width(width), height(height), dpi(dpi), stream_open(false), rows_written(0)
+{
+}
+
+// destructor for the class
+PNGStreamWriter::~PNGStreamWriter() {
+    if(stream_open)
+        deflateEnd(&stream);
+}
+
+// function that will create the file and write the header of the image along with its dpi
+bool PNGStreamWriter::open() {
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    // the rows are compressed as one stream across every chunk of image data
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    if(deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+        return false;
+    stream_open = true;
+    row.resize(1 + 3 * width);
+    compressed.resize(PNG_CHUNK_SIZE);
+
+    // the header describes an 8 bit RGB image without interlacing
+    QByteArray header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.append((char) 8);
+    header.append((char) 2);
+    header.append((char) 0);
+    header.append((char) 0);
+    header.append((char) 0);
+
+    // the dpi is stored as pixels per metre
+    QByteArray physical;
+    quint32 pixels_per_metre = qRound(dpi / 0.0254);
+    appendBigEndian(physical, pixels_per_metre);
+    appendBigEndian(physical, pixels_per_metre);
+    physical.append((char) 1);
+
+    return file.write(PNG_SIGNATURE, 8) == 8 && writeChunk("IHDR", header) && writeChunk("pHYs", physical);
+}
+
+// function that will write the first count rows of the given image. each row is stored as the difference from the
+// pixel to its left, which compresses the long runs of a single colour on a board far better than the pixels do
+bool PNGStreamWriter::writeRows(const QImage &rows, int count) {
+    if(rows.width() != width || count > rows.height() || rows_written + count > height)
+        return false;
+    for(int y = 0; y < count; y++) {
+        // filter the row, the first byte of each row says which filter was used
+        const QRgb *pixels = (const QRgb *) rows.constScanLine(y);
+        uchar *filtered = (uchar *) row.data();
+        filtered[0] = 1;
+        QRgb previous = qRgb(0, 0, 0);
+        for(int x = 0; x < width; x++) {
+            filtered[1 + 3 * x] = qRed(pixels[x]) - qRed(previous);
+            filtered[2 + 3 * x] = qGreen(pixels[x]) - qGreen(previous);
+            filtered[3 + 3 * x] = qBlue(pixels[x]) - qBlue(previous);
+            previous = pixels[x];
+        }
+
+        // and compress it
+        stream.next_in = (Bytef *) row.data();
+        stream.avail_in = row.size();
+        if(!deflateRows(Z_NO_FLUSH))
+            return false;
+    }
+    rows_written += count;
+    return true;
+}
+
+// function that will finish off the file once every row has been written
+bool PNGStreamWriter::finish() {
+    if(rows_written != height || !deflateRows(Z_FINISH))
+        return false;
+    deflateEnd(&stream);
+    stream_open = false;
+    if(!writeChunk("IEND", QByteArray()))
+        return false;
+    file.close();
+    return file.error() == QFileDevice::NoError;
+}
+
+// private function that will write a chunk of the file. the checksum covers the type and the data
+bool PNGStreamWriter::writeChunk(const char *type, const QByteArray &data) {
+    QByteArray chunk;
+    appendBigEndian(chunk, data.size());
+    chunk.append(type, 4);
+    chunk.append(data);
+    appendBigEndian(chunk, crc32(crc32(0L, Z_NULL, 0), (const Bytef *) chunk.constData() + 4, data.size() + 4));
+    return file.write(chunk) == chunk.size();
+}
+
+// private function that will compress everything waiting in the stream, writing each full buffer out as a chunk
+bool PNGStreamWriter::deflateRows(int flush) {
+    int result;
+    do {
+        stream.next_out = (Bytef *) compressed.data();
+        stream.avail_out = compressed.size();
+        result = deflate(&stream, flush);
+        if(result == Z_STREAM_ERROR)
+            return false;
+        int produced = compressed.size() - stream.avail_out;
+        if(produced > 0 && !writeChunk("IDAT", QByteArray::fromRawData(compressed.constData(), produced)))
+            return false;
+    } while(stream.avail_out == 0 || (flush == Z_FINISH && result == Z_OK));
+    return true;
+}
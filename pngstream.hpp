@@ -0,0 +1,52 @@
+#ifndef _PNGSTREAM_HPP
+#define _PNGSTREAM_HPP
+
+// pngstream.hpp
+//
+// describes writing a PNG file a few rows at a time. QImage can only write an image that is held in memory all at
+// once, which is too much for boards exported far above 4K, so those are drawn in strips and each strip is
+// compressed and written out before the next one is drawn
+
+// includes
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <zlib.h>
+
+// class definition
+class PNGStreamWriter {
+// public section of the class
+public:
+    // constructor for the class. the file will hold an RGB image of the given size, marked as being at the given dpi
+    PNGStreamWriter(const QString &filename, int width, int height, qreal dpi);
+    // destructor for the class. a file that hasn't been finished is closed as it is
+    ~PNGStreamWriter();
+    // function that will create the file and write everything that comes before the rows of the image
+    bool open();
+    // function that will write the first count rows of the given image, which must be as wide as the file
+    bool writeRows(const QImage &rows, int count);
+    // function that will finish off the file once every row has been written
+    bool finish();
+// private section of the class
+private:
+    // private function that will write a chunk of the file with the given type and data
+    bool writeChunk(const char *type, const QByteArray &data);
+    // private function that will compress everything waiting in the stream, writing it out whenever the buffer is
+    // full. the flush is passed on to zlib
+    bool deflateRows(int flush);
+    // the file being written, the size of the image and its dpi
+    QFile file;
+    int width, height;
+    qreal dpi;
+    // the zlib stream compressing the rows and whether it has been set up
+    z_stream stream;
+    bool stream_open;
+    // the filtered row being compressed and the buffer for the compressed data
+    QByteArray row;
+    QByteArray compressed;
+    // how many rows have been written so far
+    int rows_written;
+};
+
+#endif // _PNGSTREAM_HPP
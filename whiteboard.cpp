@@ -21,7 +21,7 @@
 
 // constructor for the class
 Whiteboard::Whiteboard(QWidget* parent)
-: QWidget(parent), current_colour(0, 0, 0), pen(QColor(0, 0, 0)), tool(OP_POINT_SQUARE), current_line_thickness(2), current_point_size(6), image_current(0), image_max(16), image_total(1), on_preview(false), font(QString("Arial"), 20), text_size(20), text_rotation(0), text(QString("Placeholder text to draw")), image_import_filename("")
+: QWidget(parent), current_colour(0, 0, 0), pen(QColor(0, 0, 0)), tool(OP_POINT_SQUARE), current_line_thickness(2), current_point_size(6), read_only(false), image_current(0), image_max(16), image_total(1), on_preview(false), on_history(false), history_position(0), font(QString("Arial"), 20), text_size(20), text_rotation(0), text(QString("Placeholder text to draw")), image_import_filename(""), renderer(SCREEN_RENDER_OPTIONS)
 {
     // add in a shortcut that will allow us to quit the application
     new QShortcut(QKeySequence(Qt::CTRL + Qt::Key_Q), this, SLOT(quitApplication()));
@@ -118,10 +118,29 @@ void Whiteboard::addNewImage() {
         image_total++;
     }
 
+    // remember where the image went for the next save
+    JournalEvent event = {JOURNAL_INSERT, image_current};
+    for(unsigned int i = 0; i < TOTAL_JOURNALS; i++)
+        journal_events[i].append(event);
+
     // force a repaint after a new image has been added
     repaint();
 }
 
+// function that will add a copy of the current image directly after it. the copy shares the draw operations
+// of the original so it is made instantly and only takes up memory once one of them is changed
+void Whiteboard::duplicateImage() {
+    // take a reference to the current image before a new one is added after it
+    DrawOperations *source = images[image_current];
+
+    // add a new image and make it a copy of the source
+    addNewImage();
+    images[image_current]->duplicateFrom(source);
+
+    // force a repaint now that the copy is in place
+    repaint();
+}
+
 // function that will return the full list of draw images
 DrawOperations **Whiteboard::drawOperations() {
     return images;
@@ -144,50 +163,11 @@ void Whiteboard::deleteImage() {
         images[image_total - 1] = temp;
     }
 
-    // reduce the number of images
+    // reduce the number of images and remember which one went for the next save
     image_total--;
-}
-
-// function that will run the draw commands on a QImage and will return it
-// this is for exporting purposes
-QImage *Whiteboard::exportBoard(const unsigned int board) {
-    // the QImage that we will return
-    QImage *image = new QImage(1920, 1080, QImage::Format_RGB32);
-
-    // take a copy of the current image value and replace it with board
-    unsigned int temp = image_current;
-    image_current = board;
-
-    // begin the painter object and set the current paint colour
-    QPainter painter;
-    painter.begin(image);
-
-    // draw the board
-    drawBoard(painter);
-
-    // at the bottom left of the image draw some text denoting the position of this image in the set
-    QFont tempfont(QString("Arial"), 20);
-    painter.save();
-    painter.setFont(tempfont);
-    painter.translate(32, 1052);
-    painter.setPen(QColor(0, 0, 0));
-    painter.drawText(0, 0, QString("(%1 / %2)").arg(image_current + 1).arg(image_total));
-    painter.restore();
-
-    // at the bottom middle of the image draw some text denoting the title of the image
-    painter.save();
-    painter.setFont(tempfont);
-    painter.translate(256, 1052);
-    painter.setPen(QColor(0, 0, 0));
-    painter.drawText(0, 0, images[image_current]->title);
-    painter.restore();
-
-    // end the current painting
-    painter.end();
-
-    // reset the current image and return the image when finished
-    image_current = temp;
-    return image;
+    JournalEvent event = {JOURNAL_DELETE, image_current};
+    for(unsigned int i = 0; i < TOTAL_JOURNALS; i++)
+        journal_events[i].append(event);
 }
 
 // function that will tell us if the current image is locked
@@ -196,6 +176,24 @@ const bool Whiteboard::imageLocked() {
     return images[image_current]->locked;
 }
 
+// function that will tell us if the current image is still being loaded in
+const bool Whiteboard::imagePending() {
+    return image_current < (unsigned int) pending_images.size() && pending_images[image_current];
+}
+
+// function that will return how far into its history the current image is being shown
+const unsigned int Whiteboard::historyPosition() {
+    if(on_history)
+        return qMin(history_position, images[image_current]->total_ops);
+    return images[image_current]->total_ops;
+}
+
+// function that will return the images that have been inserted and deleted since the whiteboard was last written
+// to the file of the given journal
+const QVector<JournalEvent> &Whiteboard::journalEvents(unsigned int journal) {
+    return journal_events[journal];
+}
+
 // function that will return the title of the current image
 const QString &Whiteboard::imageTitleCurrent() {
     return images[image_current]->title;
@@ -206,11 +204,31 @@ void Whiteboard::lockImage() {
     images[image_current]->lockImage();
 }
 
+// function that will record that everything in the whiteboard is now held in the file of the given journal
+void Whiteboard::markSaved(unsigned int journal) {
+    for(unsigned int i = 0; i < image_total; i++)
+        images[i]->markJournalled(journal);
+    journal_events[journal].clear();
+}
+
 // function that will return the maximum number of images in this whiteboard
 const unsigned int Whiteboard::maxImages() {
     return image_max;
 }
 
+// function that will put an image that has finished loading in place of its empty image
+void Whiteboard::replaceImage(unsigned int index, DrawOperations *operations) {
+    delete images[index];
+    images[index] = operations;
+    pending_images[index] = false;
+
+    // if the image is on screen then show it from the start of its history
+    if(index == image_current) {
+        on_history = false;
+        repaint();
+    }
+}
+
 // function that will replace the current set of images with this set of images
 void Whiteboard::setDrawOperations(DrawOperations **operations, const unsigned int total, const unsigned int max) {
     // delete the current array of objects and put a new one in its place
@@ -223,6 +241,9 @@ void Whiteboard::setDrawOperations(DrawOperations **operations, const unsigned i
     image_current = 0;
     image_total = total;
     image_max = max;
+    for(unsigned int i = 0; i < TOTAL_JOURNALS; i++)
+        journal_events[i].clear();
+    pending_images.clear();
 
     // force a repaint when the images have been replaced
     repaint();
@@ -248,6 +269,17 @@ void Whiteboard::setImportImageFilename(const QString &filename) {
     }
 }
 
+// function that will mark which of the images are still being loaded in
+void Whiteboard::setPendingImages(const QVector<bool> &pending) {
+    pending_images = pending;
+    repaint();
+}
+
+// function that will stop anything being drawn on or undone in any of the images
+void Whiteboard::setReadOnly(bool read_only) {
+    this->read_only = read_only;
+}
+
 // function that will reset the state of the whiteboard to its original state
 void Whiteboard::resetWhiteBoard() {
     // delete the current array of objects and put a new one in its place
@@ -261,6 +293,9 @@ void Whiteboard::resetWhiteBoard() {
     image_current = 0;
     image_max = 16;
     image_total = 1;
+    for(unsigned int i = 0; i < TOTAL_JOURNALS; i++)
+        journal_events[i].clear();
+    pending_images.clear();
 }
 
 // function that states how many images in total this whiteboard has thus far
@@ -268,11 +303,44 @@ const unsigned int Whiteboard::totalImages() {
     return image_total;
 }
 
+// function that states how many draw operations the current image has
+const unsigned int Whiteboard::totalOps() {
+    return images[image_current]->total_ops;
+}
+
 // function that unlocks the current image
 void Whiteboard::unlockImage() {
     images[image_current]->unlockImage();
 }
 
+// function that will throw away an image that has been loaded in, leaving an empty image with its title that is
+// marked as still being loaded in. this is how the viewer keeps only the images it has viewed recently
+void Whiteboard::unloadImage(unsigned int index) {
+    DrawOperations *empty = (DrawOperations *) new DrawOperations();
+    empty->title = images[index]->title;
+    empty->thumbnail = images[index]->thumbnail;
+    delete images[index];
+    images[index] = empty;
+    if(pending_images.size() < (int) image_total)
+        pending_images.resize(image_total);
+    pending_images[index] = true;
+}
+
+// function that will take the thumbnails drawn for a snapshot of the images by a save. an image only takes the
+// thumbnail of its snapshot if it hasn't changed since, which is the case while it still shares its operations with
+// the snapshot and has as many of them, as removing an operation from shared operations copies them first
+void Whiteboard::updateThumbnails(DrawOperations **snapshot, unsigned int total_images) {
+    for(unsigned int i = 0; i < image_total && i < total_images; i++) {
+        if(images[i]->thumbnailCurrent() || !snapshot[i]->thumbnailCurrent())
+            continue;
+        if(images[i]->operations != snapshot[i]->operations || images[i]->total_ops != snapshot[i]->total_ops)
+            continue;
+        images[i]->thumbnail = snapshot[i]->thumbnail;
+        images[i]->thumbnail_ops = snapshot[i]->thumbnail_ops;
+        images[i]->thumbnail_valid = true;
+    }
+}
+
 // public slot that will change the current draw colour
 void Whiteboard::changeColour(int red, int green, int blue) {
     current_colour.setRed(red);
@@ -283,8 +351,9 @@ void Whiteboard::changeColour(int red, int green, int blue) {
 // public slot that will change the current image. note that we decrement the value provided here
 // by one to account for indices starting at zero
 void Whiteboard::changeImage(int number) {
-    // change the image index and force a repaint
+    // change the image index, go back to showing the whole image and force a repaint
     image_current = (unsigned int)(number) - 1;
+    on_history = false;
     repaint();
 }
 
@@ -321,6 +390,14 @@ void Whiteboard::changeTextSize(int text_size) {
     font.setPointSize(text_size);
 }
 
+// slot that will show the current image as it was after the given number of draw operations. showing all of the
+// operations takes the image out of the history and back to normal
+void Whiteboard::changeHistoryPosition(int position) {
+    history_position = (unsigned int) position;
+    on_history = history_position < images[image_current]->total_ops;
+    repaint();
+}
+
 // public slot taht will change the current draw tool
 void Whiteboard::changeTool(unsigned int tool) {
     this->tool = tool;
@@ -334,6 +411,16 @@ void Whiteboard::changeTool(unsigned int tool) {
 
 // overridden mousePressEvent function that will start a user's drawing
 void Whiteboard::mousePressEvent(QMouseEvent* event) {
+    // nothing can be drawn on an image that is still being loaded in or when the whiteboard is read only
+    if(imagePending() || read_only)
+        return;
+
+    // drawing always happens on the whole image so step out of the history if we are in it
+    if(on_history) {
+        on_history = false;
+        emit historyChanged();
+    }
+
     // start preview mode and take the current pixel values
     on_preview = true;
     preview_start_x = event->x();
@@ -356,6 +443,10 @@ void Whiteboard::mousePressEvent(QMouseEvent* event) {
 
 // overridden mouseMoveEvent function that will continue a user's drawing
 void Whiteboard::mouseMoveEvent(QMouseEvent* event) {
+    // nothing can be drawn on an image that is still being loaded in, or carried on if it was pressed on one
+    if(imagePending() || !on_preview)
+        return;
+
     // take a copy of the x and y values
     preview_end_x = event->x();
     preview_end_y = event->y();
@@ -375,6 +466,10 @@ void Whiteboard::mouseMoveEvent(QMouseEvent* event) {
 
 // overridden mouse release event that will finish drawing events
 void Whiteboard::mouseReleaseEvent(QMouseEvent* event) {
+    // nothing can be drawn on an image that is still being loaded in, or carried on if it was pressed on one
+    if(imagePending() || !on_preview)
+        return;
+
     // end preview mode
     on_preview = false;
 
@@ -429,9 +524,10 @@ void Whiteboard::mouseReleaseEvent(QMouseEvent* event) {
         images[image_current]->addDrawSVGImage(image_import_filename, preview_start_x, preview_start_y, preview_width, preview_height);
     }
 
-    // repaint the view and state the board has been modified
+    // repaint the view and state the board and its history have been modified
     repaint();
     emit modified();
+    emit historyChanged();
 }
 
 // overridden paint event class that will paint the screen
@@ -443,6 +539,16 @@ void Whiteboard::paintEvent(QPaintEvent* event) {
     // draw the board
     drawBoard(painter);
 
+    // let the user know if the image is still being loaded in, showing its thumbnail in the meantime if it has one
+    if(imagePending()) {
+        QImage thumbnail = QImage::fromData(images[image_current]->thumbnail);
+        if(!thumbnail.isNull())
+            painter.drawImage(QRect(0, 0, 1920, 1080), thumbnail);
+        painter.setPen(QColor(0, 0, 0));
+        painter.setFont(QFont(QString("Arial"), 20));
+        painter.drawText(32, 52, QString("Loading..."));
+    }
+
     // end the current painting
     painter.end();
 
@@ -505,14 +611,9 @@ void Whiteboard::requestSaveShortcut() {
     emit requestSave();
 }
 
-// function that will call on QT to quit the application
+// slot that will request the application to quit. the main window decides if there is anything to deal with first
 void Whiteboard::quitApplication() {
-    // reset the cursor to the default before going any further
-    QApplication::setOverrideCursor(QCursor(Qt::ArrowCursor));
-    this->setVisible(false);
-
-    // call the quit function
-    QApplication::quit();
+    emit requestQuit();
 }
 
 // slot that will request the application to put keyboard focus on the text to be inserted
@@ -529,49 +630,33 @@ void Whiteboard::requestTitleFocusShortcut() {
 
 // function that will undo the last draw operation
 void Whiteboard::undoLastDrawOp() {
-    // if the next op is already zero then we cant remove anything
-    if(images[image_current]->total_ops == 0)
+    // if the next op is already zero or the whiteboard is read only then we cant remove anything
+    if(images[image_current]->total_ops == 0 || read_only)
         return;
 
-    // remove the last operation and redraw the screen
+    // remove the last operation, step out of the history and redraw the screen
     images[image_current]->removeLastDrawData();
+    on_history = false;
     repaint();
+    emit historyChanged();
 }
 
 // refactored private function that will draw the board with the provided painter object. function
 // will assume that painter has been started before calling and will be ended after calling
 void Whiteboard::drawBoard(QPainter &painter) {
-    // draw a white background on the view
-    painter.setPen(QColor(255, 255, 255));
-    painter.setBrush(QColor(255, 255, 255));
-    painter.drawRect(0, 0, 1920, 1080);
-
-    // go through all of the draw operations that are in the list
-    for(unsigned int i = 0; i < images[image_current]->total_ops; i++) {
-        // go through each of the draw ops and perform the necessary action
-        if(images[image_current]->operations[i].draw_operation == POINT_CIRCLE) {
-            drawPointCircle(painter, i);
-        } else if(images[image_current]->operations[i].draw_operation == POINT_SQUARE) {
-            drawPointSquare(painter, i);
-        } else if(images[image_current]->operations[i].draw_operation == POINT_X) {
-            drawPointX(painter, i);
-        } else if(images[image_current]->operations[i].draw_operation == STRAIGHT_LINE_END) {
-            drawStraightLine(painter, i);
-        } else if(images[image_current]->operations[i].draw_operation == LINE_START) {
-            i = drawFreehandLine(painter, i);
-        } else if(images[image_current]->operations[i].draw_operation == DRAW_TEXT) {
-            drawText(painter, i);
-        } else if(images[image_current]->operations[i].draw_operation == DRAW_RASTER) {
-            drawRasterImage(painter, i);
-        } else if(images[image_current]->operations[i].draw_operation == DRAW_SVG) {
-            drawSVGImage(painter, i);
-        }
-    }
+    // see how far into the history of the board we are drawing
+    unsigned int end = images[image_current]->total_ops;
+    if(on_history && history_position < end)
+        end = history_position;
+
+    // draw the board, making sure we are still within our budget if a new keyframe was baked to draw it
+    if(renderer.render(images[image_current], painter, end))
+        trimKeyframes(end);
 
     // draw the preview in a cyan colour for all operations bar the free form line
     painter.setPen(QColor(0, 255, 255));
     painter.setBrush(QColor(0, 255, 255));
-    if(on_preview) {
+    if(on_preview && !on_history) {
         if(tool == OP_POINT_SQUARE) {
             // draw a preview square at the last known location
             painter.drawRect(preview_end_x - current_point_size / 2, preview_end_y - current_point_size / 2, current_point_size, current_point_size);
@@ -632,142 +717,33 @@ void Whiteboard::drawBoard(QPainter &painter) {
     }
 }
 
-// private function that will draw a freehand line. this will return an updated index once the line is drawn.
-// assumes that the index is on a line start, this is meant an an optimisation to reduce the amount of if statements
-// and function calls used to draw a freehand line
-unsigned int Whiteboard::drawFreehandLine(QPainter &painter, unsigned int index) {
-    // get a reference to the line start
-    LineStart *start = (LineStart *) &images[image_current]->operations[index++];
-    int old_x = start->x;
-    int old_y = start->y;
-
-    // take a reference to the colour and the size as these will not change throughout the line draw
-    unsigned int p_colour = start->colour;
-    unsigned int size = start->size;
-
-    // set the pen with the right thickness and the brush
-    QPen pen;
-    pen.setColor(p_colour);
-    pen.setWidth(size);
-    painter.setPen(pen);
-    painter.setBrush(QColor(p_colour));
-
-    // while we are still on line points keep drawing the line
-    while(images[image_current]->operations[index].draw_operation == LINE_POINT) {
-        // get a reference to the current line point and pull out the point
-        LinePoint *current = (LinePoint *) &images[image_current]->operations[index];
-        int new_x = current->x;
-        int new_y = current->y;
-
-        // draw the line segment move the new data into the old and move onto the next point
-        painter.drawLine(old_x, old_y, new_x, new_y);
-        old_x = new_x;
-        old_y = new_y;
-        index++;
+// private function that will throw away keyframes until we are back within our budget. keyframes of the other
+// boards go first and then the ones of the current board that are furthest from the position being drawn
+void Whiteboard::trimKeyframes(unsigned int position) {
+    // count up how many keyframes we have across all of the boards
+    int total = 0;
+    for(unsigned int i = 0; i < image_max; i++)
+        total += images[i]->keyframes.size();
+
+    // drop the keyframes of every other board while we are over budget
+    for(unsigned int i = 0; i < image_max && total > (int) MAX_KEYFRAMES; i++) {
+        if(i == image_current)
+            continue;
+        total -= images[i]->keyframes.size();
+        images[i]->keyframes.clear();
     }
 
-    // if we have the end of the line so pull this out and draw the end of the line
-    if(images[image_current]->operations[index].draw_operation == LINE_END) {
-        LineEnd *end = (LineEnd *) &images[image_current]->operations[index];
-        painter.drawLine(old_x, old_y, end->x, end->y);
+    // drop the keyframes of the current board that are furthest from the position
+    QMap<unsigned int, QImage> &keyframes = images[image_current]->keyframes;
+    while(total > (int) MAX_KEYFRAMES) {
+        unsigned int first = keyframes.firstKey();
+        unsigned int last = keyframes.lastKey();
+        if(position - qMin(position, first) > qMax(position, last) - position)
+            keyframes.remove(first);
+        else
+            keyframes.remove(last);
+        total--;
     }
-
-    // return the updated index
-    return index;
-}
-
-// refactored private function that will draw a point circle, and an index into the current image that contains the data
-void Whiteboard::drawPointCircle(QPainter &painter, unsigned int index) {
-    // get the circle point structure set the pen and draw the point
-    PointCircle *temp = (PointCircle *) &images[image_current]->operations[index];
-    painter.setPen(QColor(temp->colour));
-    painter.setBrush(QColor(temp->colour));
-    painter.drawEllipse(temp->x - (temp->size / 2), temp->y - (temp->size / 2), temp->size, temp->size);
-}
-
-// refactored private function that will draw a point square, and an index into the current image that contains the data
-void Whiteboard::drawPointSquare(QPainter &painter, unsigned int index) {
-    // get the square point structure set teh pen and draw the point
-    PointSquare *temp = (PointSquare *) &images[image_current]->operations[index];
-    painter.setPen(QColor(temp->colour));
-    painter.setBrush(QColor(temp->colour));
-    painter.drawRect(temp->x - (temp->size / 2), temp->y - (temp->size / 2), temp->size, temp->size);
-}
-
-// refactored private function that will draw a point x
-void Whiteboard::drawPointX(QPainter &painter, unsigned int index) {
-    // get the x point structure set teh pen and draw the point
-    PointX *temp = (PointX *) &images[image_current]->operations[index];
-    QPen pen(QColor(temp->colour));
-    pen.setWidth(2);
-    painter.setPen(pen);
-    painter.setBrush(QColor(temp->colour));
-
-    // draw the two lines to make the x point
-    painter.drawLine(temp->x - (temp->size / 2), temp->y - (temp->size / 2), temp->x + (temp->size / 2), temp->y + (temp->size / 2));
-    painter.drawLine(temp->x + (temp->size / 2), temp->y - (temp->size / 2), temp->x - (temp->size / 2), temp->y + (temp->size / 2));
-}
-
-// private function that will draw a raster image
-void Whiteboard::drawRasterImage(QPainter &painter, unsigned int index) {
-    // get a reference to the image for drawing
-    RasterImage *temp = (RasterImage *) &images[image_current]->operations[index];
-
-    // draw the image on the board by first specifiing the rects that match the source size and the request destination size
-    QRectF source(0, 0, temp->image->width(), temp->image->height());
-    QRectF destination(temp->x, temp->y, temp->width, temp->height);
-    painter.drawImage(destination, *temp->image, source);
-}
-
-// private function that will draw a straight line
-void Whiteboard::drawStraightLine(QPainter &painter, unsigned int index) {
-    // get references to the start and end of the straight line
-    StraightLineStart *start = (StraightLineStart *) &images[image_current]->operations[index - 1];
-    StraightLineEnd *end = (StraightLineEnd *) &images[image_current]->operations[index];
-
-    // set teh pen with the right thickness and the brush
-    QPen pen(QColor(end->colour));
-    pen.setWidth(end->size);
-    painter.setPen(pen);
-    painter.setBrush(QColor(end->colour));
-
-    // draw the line
-    painter.drawLine(start->x, start->y, end->x, end->y);
-}
-
-// private function that will draw an SVG image
-void Whiteboard::drawSVGImage(QPainter &painter, unsigned int index) {
-    // get a reference to the image for drawing
-    SVGImage *temp = (SVGImage *) &images[image_current]->operations[index];
-
-    // draw the image on the board by first specifiing the rects that match the source size and the request destination size
-    QRectF destination(temp->x, temp->y, temp->width, temp->height);
-    temp->image->render(&painter, destination);
-}
-
-// refactored private function that will draw text
-void Whiteboard::drawText(QPainter &painter, unsigned int index) {
-    // get a reference to the text for drawing
-    Text *temp = (Text *) &images[image_current]->operations[index];
-
-    // get the font metrics and determine the width of the string
-    QFontMetrics metrics = painter.fontMetrics();
-    int width = metrics.horizontalAdvance(*temp->string);
-    int height = metrics.height();
-
-    // we will need to save, translate to the position, and rotate by the given angle
-    painter.save();
-    painter.translate(temp->x, temp->y);
-    painter.rotate(temp->rotation);
-
-    // draw the text on the board
-    QFont tempfont("Arial", temp->size);
-    painter.setPen(QColor(temp->colour));
-    painter.setFont(tempfont);
-    painter.drawText(-width, height / 2, *temp->string);
-
-    // restore our painter state
-    painter.restore();
 }
 
 // private function that will snap the straight line to one of the 8 caridnal directions
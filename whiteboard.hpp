@@ -14,7 +14,9 @@
 #include <QPen>
 #include <QPainter>
 #include <QPaintEvent>
+#include <QVector>
 #include <QWidget>
+#include "boardrenderer.hpp"
 #include "drawoperations.hpp"
 
 // class defintion
@@ -34,31 +36,56 @@ public:
     DrawOperations **drawOperations();
     // function that will delete the currently selected image
     void deleteImage();
-    // function that will run the draw commands on a QImage and will return it
-    // this is for exporting purposes
-    QImage *exportBoard(const unsigned int board);
+    // function that will add a copy of the current image directly after it
+    void duplicateImage();
+    // function that will return how far into its history the current image is being shown
+    const unsigned int historyPosition();
     // function that will tell us if the current image is locked
     const bool imageLocked();
+    // function that will tell us if the current image is still being loaded in
+    const bool imagePending();
+    // function that will return the images that have been inserted and deleted since the whiteboard was last
+    // written to the file of the given journal
+    const QVector<JournalEvent> &journalEvents(unsigned int journal);
     // function that will return the title of the current image
     const QString &imageTitleCurrent();
     // function that will set the lock on the current image
     void lockImage();
+    // function that will record that everything in the whiteboard is now held in the file of the given journal
+    void markSaved(unsigned int journal);
     // function that will return the maximum number of images in this whiteboard
     const unsigned int maxImages();
+    // function that will put an image that has finished loading in place of its empty image
+    void replaceImage(unsigned int index, DrawOperations *operations);
     // function that will replace the current set of images with this set of images
     void setDrawOperations(DrawOperations **operations, const unsigned int total, const unsigned int max);
     // function that will set the filename of the image to be imported on the next draw operation
     void setImportImageFilename(const QString &filename);
+    // function that will stop anything being drawn on or undone in any of the images
+    void setReadOnly(bool read_only);
+    // function that will mark which of the images are still being loaded in. these can't be drawn on until they
+    // have been replaced
+    void setPendingImages(const QVector<bool> &pending);
     // function that will reset the whiteboard to its starting conditions
     void resetWhiteBoard();
     // function that states how many images in total this whiteboard has thus far
     const unsigned int totalImages();
+    // function that states how many draw operations the current image has
+    const unsigned int totalOps();
     // function that unlocks the current image
     void unlockImage();
+    // function that will throw away an image that has been loaded in, leaving an empty image with its title that
+    // is marked as still being loaded in
+    void unloadImage(unsigned int index);
+    // function that will take the thumbnails drawn for a snapshot of the images by a save, for every image that
+    // hasn't changed since the snapshot was taken
+    void updateThumbnails(DrawOperations **snapshot, unsigned int total_images);
 // public slots of the class
 public slots:
     // slot that will change the current draw colour to the indicated colour
     void changeColour(int red, int green, int blue);
+    // slot that will show the current image as it was after the given number of draw operations
+    void changeHistoryPosition(int position);
     // slot that will change the current image to the given number
     void changeImage(int number);
     // slot that will change the title of the current image
@@ -93,8 +120,12 @@ signals:
     void goBackImage();
     // signal to go back a tool
     void goBackTool();
+    // signal that will be emitted when the number of draw operations on the current image has changed
+    void historyChanged();
     // signal that will be emitted to say this whiteboard was modified
     void modified();
+    // signal requesting the application to quit
+    void requestQuit();
     // signal that will request that rotation is decreased to the left
     void requestRotateLeft();
     // signal that will request that rotation is increased to the right
@@ -135,7 +166,7 @@ private slots:
     void goBackToolShortcut();
     // slot that will emit a signal to increase the size or thickness of the current draw op
     void increaseSizeShortcut();
-    // slot for quitting the application
+    // slot that will request the application to quit
     void quitApplication();
     // slot that will request the application increases rotation to the right
     void requestRotateRightShortcut();
@@ -154,25 +185,10 @@ private:
     // private function that will draw the board with the provided painter object. function
     // will assume that painter has been started before calling and will be ended after calling
     void drawBoard(QPainter &painter);
-    // private function that will draw a freehand line. this will return an updated index once the line is drawn.
-    // assumes that the index is on a line start,
-    unsigned int drawFreehandLine(QPainter &painter, unsigned int index);
-    // private function that will draw a point circle, and an index into the current image that contains the data
-    void drawPointCircle(QPainter &painter, unsigned int index);
-    // private function that will draw a point square, and an index into the current image that contains the data
-    void drawPointSquare(QPainter &painter, unsigned int index);
-    // private function that will draw a point x
-    void drawPointX(QPainter &painter, unsigned int index);
-    // private function that will draw a raster image
-    void drawRasterImage(QPainter &painter, unsigned int index);
-    // private function that will draw a straight line assumes the current index is a straight line end
-    void drawStraightLine(QPainter &painter, unsigned int index);
-    // private function that will draw an SVG image
-    void drawSVGImage(QPainter &painter, unsigned int index);
-    // private function that will draw text
-    void drawText(QPainter &painter, unsigned int index);
     // private function that will snap the straight line to one of the 8 caridnal directions
     void snapStraightLine();
+    // private function that will throw away keyframes until we are back within our budget
+    void trimKeyframes(unsigned int position);
     // the current drawing colour
     QColor current_colour;
     // pen for drawing a point, and pen draw drawing lines
@@ -184,6 +200,13 @@ private:
     // draw operations array that will hold all of the images for this whiteboard. note we set these
     // all up as pointers as we will need to shift them around
     DrawOperations **images;
+    // the images that have been inserted and deleted since the whiteboard was last written to the file of each
+    // journal, in the order it happened
+    QVector<JournalEvent> journal_events[TOTAL_JOURNALS];
+    // which of the images are still being loaded in. this is empty once every image has been loaded
+    QVector<bool> pending_images;
+    // can the images be drawn on
+    bool read_only;
     // the current image we are looking at and the maximum number of images we have
     unsigned int image_current;
     unsigned int image_max;
@@ -194,6 +217,9 @@ private:
     unsigned int preview_end_x, preview_end_y;
     // are we in the middle of a preview draw (i.e. currently on pressed or move not released)
     bool on_preview;
+    // are we showing the current image part way through its history and if so after how many operations
+    bool on_history;
+    unsigned int history_position;
     // the font that will be used for writing text to the board
     QFont font;
     // the text size, rotation and text to be displayed for the draw text operation
@@ -205,6 +231,8 @@ private:
     // preview image width and height
     int preview_image_width;
     int preview_image_height;
+    // the renderer that draws the images on screen
+    BoardRenderer renderer;
 };
 
 #endif // _WHITEBOARD_HPP